@@ -0,0 +1,409 @@
+#include <algorithm>
+#include "BallRenderer.h"
+#include "RenderSimd.h"
+#include "SDL2_gfx/SDL2_gfxPrimitives.h"
+
+// Same colors as the SDL2_gfx path
+const SDL_Color OUTLINE_COLOR = {0xFF, 0xFF, 0xFF, 0xFF};
+const SDL_Color X_AXIS_COLOR = {0xFF, 0x00, 0x00, 0xFF * 4 / 5};
+const SDL_Color Y_AXIS_COLOR = {0x00, 0x00, 0xFF, 0xFF * 4 / 5};
+const SDL_Color CENTER_COLOR = {0x00, 0xFF, 0x00, 0xFF};
+
+// Level of detail : radii on the screen, in pixels, under which a ball is
+// at most a disc and a point, whatever the number of balls
+const cpFloat DISC_MAX_RADIUS = 4;
+const cpFloat POINT_MAX_RADIUS = 1.5;
+
+// Starting limits of the number of visible balls drawn in full and as
+// discs, adapted from the frame times afterwards
+const unsigned FULL_DETAIL_LIMIT = 2000;
+const unsigned DISC_DETAIL_LIMIT = 20000;
+
+// A frame is over the budget once its work takes that share of the budget,
+// the rest being left to the present, and the level of detail is lowered
+// after a few of them in a row
+const double SLOW_FRAME_RATIO = 0.8;
+const int SLOW_FRAMES_TO_LOWER = 3;
+// Frames within the budget before a higher level of detail is tried, at
+// least and at most
+const int MIN_RAISE_DELAY = 60;
+const int MAX_RAISE_DELAY = 60 * 30;
+
+BallRenderer::BallRenderer():
+   _mode(RENDER_GEOMETRY), _atlasX(0), _atlasY(0), _atlasRowHeight(0), _asleepVersion(0),
+   _asleepViewport(cpBBNew(0, 0, 0, 0)), _asleepTransform(cpTransformIdentity), _asleepLevel(DETAIL_FULL),
+   _level(DETAIL_FULL), _visibleCount(0), _slowFrames(0), _stableFrames(0), _raiseDelay(MIN_RAISE_DELAY),
+   _raised(false), _simd(false) {
+   _detailLimits[DETAIL_FULL] = FULL_DETAIL_LIMIT;
+   _detailLimits[DETAIL_DISC] = DISC_DETAIL_LIMIT;
+   for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+      cpFloat angle = 2 * CP_PI * i / CIRCLE_SEGMENTS;
+      _unitCircle[i] = cpv(cos(angle), sin(angle));
+   }
+}
+
+void BallRenderer::free() {
+   _atlas.free();
+   _sprites.clear();
+   _atlasX = _atlasY = _atlasRowHeight = 0;
+}
+
+const char* BallRenderer::getModeName(RenderMode mode) {
+   switch (mode) {
+      case RENDER_GFX: return "SDL2_gfx";
+      case RENDER_GEOMETRY: return "geometry";
+      case RENDER_SPRITES: return "sprites";
+      default: return "?";
+   }
+}
+
+const char* BallRenderer::getDetailLevelName(DetailLevel level) {
+   switch (level) {
+      case DETAIL_FULL: return "full";
+      case DETAIL_DISC: return "discs";
+      case DETAIL_POINT: return "points";
+      default: return "?";
+   }
+}
+
+void BallRenderer::adaptDetail(double frameSeconds, double budget) {
+   ++ _stableFrames;
+   if (frameSeconds > budget * SLOW_FRAME_RATIO) {
+      if (++ _slowFrames < SLOW_FRAMES_TO_LOWER || _level == DETAIL_POINT)
+         return;
+      // The last raise did not hold, it is tried again later
+      if (_raised && _stableFrames < _raiseDelay)
+         _raiseDelay = std::min(_raiseDelay * 2, MAX_RAISE_DELAY);
+      _detailLimits[_level] = _visibleCount * 3 / 4;
+      _slowFrames = 0;
+      _stableFrames = 0;
+      _raised = false;
+      return;
+   }
+
+   _slowFrames = 0;
+   if (_level == DETAIL_FULL || _stableFrames < _raiseDelay)
+      return;
+   if (_raised)
+      _raiseDelay = MIN_RAISE_DELAY;
+   // Some room so that a few more balls do not lower it right away
+   _detailLimits[_level - 1] = _visibleCount + _visibleCount / 4 + 1;
+   _stableFrames = 0;
+   _raised = true;
+}
+
+DetailLevel BallRenderer::getDetailLevel(cpFloat radius) const {
+   if (_level == DETAIL_POINT || radius < POINT_MAX_RADIUS)
+      return DETAIL_POINT;
+   if (_level == DETAIL_DISC || radius < DISC_MAX_RADIUS)
+      return DETAIL_DISC;
+   return DETAIL_FULL;
+}
+
+void BallRenderer::render(SDL_Renderer* renderer, const BallArrays& balls, const std::vector<unsigned>& visible,
+                          cpBB viewport, cpTransform transform, cpFloat alpha) {
+   _visibleCount = visible.size();
+   _level = DETAIL_FULL;
+   while (_level < DETAIL_POINT && _visibleCount > _detailLimits[_level])
+      _level = (DetailLevel) (_level + 1);
+
+   interpolate(balls, visible, transform, alpha);
+
+   if (_mode == RENDER_GFX) {
+      clearBatch(&_awakeBatch);
+      for (unsigned k = 0; k < visible.size(); k++) {
+         unsigned i = visible[k];
+         renderGfx(renderer, _positions[k], cpv(_cosines[k], _sines[k]), balls.radii[i] * transform.a, balls.colors[i]);
+      }
+      drawBatch(renderer, _awakeBatch);
+      return;
+   }
+   if (_mode == RENDER_SPRITES) {
+      renderSprites(renderer, balls, visible, transform.a);
+      return;
+   }
+
+   renderGeometry(renderer, balls, visible, viewport, transform);
+}
+
+void BallRenderer::interpolate(const BallArrays& balls, const std::vector<unsigned>& visible, cpTransform transform,
+                               cpFloat alpha) {
+   unsigned count = visible.size();
+   _positions.resize(count);
+   _angles.resize(count);
+   _cosines.resize(count);
+   _sines.resize(count);
+   for (unsigned k = 0; k < count; k++) {
+      unsigned i = visible[k];
+      _positions[k] = cpTransformPoint(transform, cpvlerp(balls.previousPositions[i], balls.positions[i], alpha));
+      // Bodies spin freely, their angle is brought back into [-pi, pi]
+      // before losing the precision of a double
+      cpFloat angle = balls.previousAngles[i] + (balls.angles[i] - balls.previousAngles[i]) * alpha;
+      _angles[k] = angle - 2 * CP_PI * nearbyint(angle / (2 * CP_PI));
+   }
+
+   // Rotations of the balls, for the ends of their axes
+   if (_simd)
+      computeRotations(_angles.data(), count, _cosines.data(), _sines.data());
+   else {
+      for (unsigned k = 0; k < count; k++) {
+         _cosines[k] = cosf(_angles[k]);
+         _sines[k] = sinf(_angles[k]);
+      }
+   }
+}
+
+void BallRenderer::renderGeometry(SDL_Renderer* renderer, const BallArrays& balls, const std::vector<unsigned>& visible,
+                                  cpBB viewport, cpTransform transform) {
+   // Sleeping balls do not move : their triangles are only built again
+   // when some of them fall asleep, wake up or are removed, or when the
+   // camera moves
+   bool sameViewport = viewport.l == _asleepViewport.l && viewport.b == _asleepViewport.b
+                       && viewport.r == _asleepViewport.r && viewport.t == _asleepViewport.t;
+   bool sameTransform = transform.a == _asleepTransform.a && transform.tx == _asleepTransform.tx
+                        && transform.ty == _asleepTransform.ty;
+   if (balls.asleepVersion != _asleepVersion || !sameViewport || !sameTransform || _level != _asleepLevel) {
+      clearBatch(&_asleepBatch);
+      for (unsigned k = 0; k < visible.size(); k++) {
+         unsigned i = visible[k];
+         if (balls.asleep[i])
+            addBall(&_asleepBatch, cpTransformPoint(transform, balls.positions[i]), cpvforangle(balls.angles[i]),
+                    balls.radii[i] * transform.a, balls.colors[i]);
+      }
+      _asleepVersion = balls.asleepVersion;
+      _asleepViewport = viewport;
+      _asleepTransform = transform;
+      _asleepLevel = _level;
+   }
+
+   clearBatch(&_awakeBatch);
+   for (unsigned k = 0; k < visible.size(); k++) {
+      unsigned i = visible[k];
+      if (!balls.asleep[i])
+         addBall(&_awakeBatch, _positions[k], cpv(_cosines[k], _sines[k]), balls.radii[i] * transform.a, balls.colors[i]);
+   }
+
+   drawBatch(renderer, _asleepBatch);
+   drawBatch(renderer, _awakeBatch);
+}
+
+void BallRenderer::drawBatch(SDL_Renderer* renderer, const GeometryBatch& batch) {
+   if (!batch.indices.empty())
+      SDL_RenderGeometry(renderer, NULL, batch.vertices.data(), batch.vertices.size(),
+                         batch.indices.data(), batch.indices.size());
+
+   for (int c = 0; c < POINT_COLORS; c++) {
+      if (batch.points[c].empty())
+         continue;
+      // Middle of the range of each 2 bits channel
+      SDL_SetRenderDrawColor(renderer, (c >> 4) * 0x55, ((c >> 2) & 3) * 0x55, (c & 3) * 0x55, 0xFF);
+      SDL_RenderDrawPointsF(renderer, batch.points[c].data(), batch.points[c].size());
+   }
+}
+
+void BallRenderer::clearBatch(GeometryBatch* batch) {
+   batch->vertices.clear();
+   batch->indices.clear();
+   for (int c = 0; c < POINT_COLORS; c++)
+      batch->points[c].clear();
+}
+
+void BallRenderer::addPoint(GeometryBatch* batch, cpVect position, Color color) {
+   int c = (color.r >> 6) << 4 | (color.g >> 6) << 2 | color.b >> 6;
+   batch->points[c].push_back({(float) position.x, (float) position.y});
+}
+
+void BallRenderer::renderGfx(SDL_Renderer* renderer, cpVect position, cpVect rotation, cpFloat radius, Color color) {
+   DetailLevel level = getDetailLevel(radius);
+   if (level == DETAIL_POINT) {
+      addPoint(&_awakeBatch, position, color);
+      return;
+   }
+
+   SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+
+   filledCircleRGBA(renderer, position.x, position.y, radius, color.r,
+                    color.g, color.b, 255 * 0.5 );
+   if (level == DETAIL_DISC)
+      return;
+   aacircleColor(renderer, position.x, position.y, radius, 0xFFFFFFFF);
+
+
+   // X:Y axis on the ball
+   cpFloat length = radius * 0.7;
+   cpVect point1 = cpv(position.x + length * rotation.y, position.y - length * rotation.x);
+   cpVect point2 = cpv(position.x + length * rotation.x, position.y + length * rotation.y);
+
+   aalineRGBA(renderer, position.x, position.y, point1.x, point1.y, 0x00, 0x00, 0xFF, 0xFF * 0.8);
+
+   aalineRGBA(renderer, position.x, position.y, point2.x, point2.y, 0xFF, 0x00, 0x00, 0xFF * 0.8);
+
+   SDL_SetRenderDrawColor(renderer, 0X00, 0xFF, 0x00, 0xFF);
+   SDL_RenderDrawPoint(renderer, position.x, position.y);
+}
+
+void BallRenderer::addBall(GeometryBatch* batch, cpVect position, cpVect rotation, cpFloat radius, Color color) {
+   DetailLevel level = getDetailLevel(radius);
+   if (level == DETAIL_POINT) {
+      addPoint(batch, position, color);
+      return;
+   }
+   SDL_Color fill = {color.r, color.g, color.b, 0xFF / 2};
+
+   // Disc as a triangle fan around the center
+   int center = addVertex(batch, position.x, position.y, fill);
+   for (int i = 0; i < CIRCLE_SEGMENTS; i++)
+      addVertex(batch, position.x + _unitCircle[i].x * radius, position.y + _unitCircle[i].y * radius, fill);
+   for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+      batch->indices.push_back(center);
+      batch->indices.push_back(center + 1 + i);
+      batch->indices.push_back(center + 1 + (i + 1) % CIRCLE_SEGMENTS);
+   }
+   if (level == DETAIL_DISC)
+      return;
+
+   // One pixel wide outline as a ring of quads
+   int ring = batch->vertices.size();
+   for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+      addVertex(batch, position.x + _unitCircle[i].x * (radius - 0.5), position.y + _unitCircle[i].y * (radius - 0.5), OUTLINE_COLOR);
+      addVertex(batch, position.x + _unitCircle[i].x * (radius + 0.5), position.y + _unitCircle[i].y * (radius + 0.5), OUTLINE_COLOR);
+   }
+   for (int i = 0; i < CIRCLE_SEGMENTS; i++) {
+      int inner = ring + 2 * i, outer = inner + 1;
+      int nextInner = ring + 2 * ((i + 1) % CIRCLE_SEGMENTS), nextOuter = nextInner + 1;
+      batch->indices.push_back(inner);
+      batch->indices.push_back(outer);
+      batch->indices.push_back(nextOuter);
+      batch->indices.push_back(inner);
+      batch->indices.push_back(nextOuter);
+      batch->indices.push_back(nextInner);
+   }
+
+   // X:Y axis on the ball
+   cpFloat length = radius * 0.7;
+   addLine(batch, position, cpv(position.x + length * rotation.y, position.y - length * rotation.x), 1, Y_AXIS_COLOR);
+   addLine(batch, position, cpv(position.x + length * rotation.x, position.y + length * rotation.y), 1, X_AXIS_COLOR);
+
+   addLine(batch, cpv(position.x - 0.5, position.y), cpv(position.x + 0.5, position.y), 1, CENTER_COLOR);
+}
+
+void BallRenderer::addLine(GeometryBatch* batch, cpVect a, cpVect b, float width, SDL_Color color) {
+   cpVect side = cpvmult(cpvperp(cpvnormalize(cpvsub(b, a))), width / 2);
+
+   int first = addVertex(batch, a.x + side.x, a.y + side.y, color);
+   addVertex(batch, b.x + side.x, b.y + side.y, color);
+   addVertex(batch, b.x - side.x, b.y - side.y, color);
+   addVertex(batch, a.x - side.x, a.y - side.y, color);
+
+   batch->indices.push_back(first);
+   batch->indices.push_back(first + 1);
+   batch->indices.push_back(first + 2);
+   batch->indices.push_back(first);
+   batch->indices.push_back(first + 2);
+   batch->indices.push_back(first + 3);
+}
+
+int BallRenderer::addVertex(GeometryBatch* batch, cpFloat x, cpFloat y, SDL_Color color) {
+   SDL_Vertex vertex;
+   vertex.position.x = x;
+   vertex.position.y = y;
+   vertex.color = color;
+   vertex.tex_coord.x = vertex.tex_coord.y = 0;
+   batch->vertices.push_back(vertex);
+   return batch->vertices.size() - 1;
+}
+
+void BallRenderer::renderSprites(SDL_Renderer* renderer, const BallArrays& balls, const std::vector<unsigned>& visible,
+                                 cpFloat scale) {
+   clearBatch(&_awakeBatch);
+   for (unsigned k = 0; k < visible.size(); k++) {
+      unsigned i = visible[k];
+      cpVect position = _positions[k];
+      cpVect rotation = cpv(_cosines[k], _sines[k]);
+      Color color = balls.colors[i];
+      DetailLevel level = getDetailLevel(balls.radii[i] * scale);
+      if (level == DETAIL_POINT) {
+         addPoint(&_awakeBatch, position, color);
+         continue;
+      }
+      const BallSprite* sprite = getSprite(renderer, balls.radii[i]);
+      if (!sprite) {
+         renderGfx(renderer, position, rotation, balls.radii[i] * scale, color);
+         continue;
+      }
+
+      // Sprites are rasterized at the size of the world, and stretched
+      float size = sprite->fill.w * scale;
+      SDL_FRect destination = {(float) position.x - size / 2, (float) position.y - size / 2, size, size};
+
+      // A disc does not need to be rotated
+      _atlas.setColor(color.r, color.g, color.b);
+      _atlas.setAlpha(0xFF / 2);
+      _atlas.renderClip(renderer, &sprite->fill, &destination, 0);
+      if (level == DETAIL_DISC)
+         continue;
+
+      _atlas.setColor(0xFF, 0xFF, 0xFF);
+      _atlas.setAlpha(0xFF);
+      _atlas.renderClip(renderer, &sprite->outline, &destination, _angles[k] * 180 / CP_PI);
+   }
+   drawBatch(renderer, _awakeBatch);
+}
+
+const BallRenderer::BallSprite* BallRenderer::getSprite(SDL_Renderer* renderer, int radius) {
+   std::map<int, BallSprite>::iterator found = _sprites.find(radius);
+   if (found != _sprites.end())
+      return &found->second;
+
+   if (_atlas.getWidth() == 0) {
+      if (!_atlas.createRenderTarget(ATLAS_SIZE, ATLAS_SIZE, renderer))
+         return NULL;
+      // Transparent white so that antialiased white edges keep their color
+      _atlas.setAsRenderTarget(renderer, true);
+      SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0x00);
+      SDL_RenderClear(renderer);
+      _atlas.setAsRenderTarget(renderer, false);
+   }
+
+   // One pixel of margin around the circle for the antialiasing
+   int size = 2 * radius + 4;
+   BallSprite sprite;
+   if (!allocateAtlasRect(size, &sprite.fill) || !allocateAtlasRect(size, &sprite.outline)) {
+      printf("Ball atlas is full, radius %d drawn with SDL2_gfx\n", radius);
+      return NULL;
+   }
+
+   _atlas.setAsRenderTarget(renderer, true);
+
+   int x = sprite.fill.x + size / 2, y = sprite.fill.y + size / 2;
+   filledCircleRGBA(renderer, x, y, radius, 0xFF, 0xFF, 0xFF, 0xFF);
+
+   x = sprite.outline.x + size / 2;
+   y = sprite.outline.y + size / 2;
+   aacircleColor(renderer, x, y, radius, 0xFFFFFFFF);
+   aalineRGBA(renderer, x, y, x, y - radius * 0.7, Y_AXIS_COLOR.r, Y_AXIS_COLOR.g, Y_AXIS_COLOR.b, Y_AXIS_COLOR.a);
+   aalineRGBA(renderer, x, y, x + radius * 0.7, y, X_AXIS_COLOR.r, X_AXIS_COLOR.g, X_AXIS_COLOR.b, X_AXIS_COLOR.a);
+   SDL_SetRenderDrawColor(renderer, CENTER_COLOR.r, CENTER_COLOR.g, CENTER_COLOR.b, CENTER_COLOR.a);
+   SDL_RenderDrawPoint(renderer, x, y);
+
+   _atlas.setAsRenderTarget(renderer, false);
+
+   return &(_sprites[radius] = sprite);
+}
+
+bool BallRenderer::allocateAtlasRect(int size, SDL_Rect* rect) {
+   // New shelf
+   if (_atlasX + size > ATLAS_SIZE) {
+      _atlasX = 0;
+      _atlasY += _atlasRowHeight;
+      _atlasRowHeight = 0;
+   }
+   if (size > ATLAS_SIZE || _atlasY + size > ATLAS_SIZE)
+      return false;
+
+   *rect = {_atlasX, _atlasY, size, size};
+   _atlasX += size;
+   if (size > _atlasRowHeight)
+      _atlasRowHeight = size;
+   return true;
+}
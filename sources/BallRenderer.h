@@ -0,0 +1,202 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <SDL2/SDL.h>
+#include "chipmunk/chipmunk.h"
+#include "Ball.h"
+#include "BallStore.h"
+#include "Texture.h"
+#include "CircleSimd.h"
+
+// Ways of drawing the balls, cycled at runtime to compare them
+enum RenderMode {
+   RENDER_GFX,       // SDL2_gfx primitives, one set of calls per ball
+   RENDER_GEOMETRY,  // every ball tessellated into a single SDL_RenderGeometry
+   RENDER_SPRITES,   // pre-rasterized sprites blitted from a texture atlas
+   NB_RENDER_MODES
+};
+
+// How much of a ball is drawn, from the most to the least detailed
+enum DetailLevel {
+   DETAIL_FULL,   // disc, antialiased outline, axes and center
+   DETAIL_DISC,   // flat disc only
+   DETAIL_POINT,  // single point of the color of the ball
+   NB_DETAIL_LEVELS
+};
+
+/**
+ * @brief Draws the balls published by the simulation. In geometry mode the
+ * whole set is tessellated into vertex and index buffers submitted with a
+ * single draw call each : one for the awake balls, built every frame, and
+ * one for the sleeping balls, kept until the set of sleeping balls or the
+ * view changes. In sprites mode each radius is rasterized once into an
+ * atlas and balls become tinted and rotated texture copies. Only the balls
+ * found visible by the simulation are drawn.
+ *
+ * Balls are drawn with less detail when they are many or small on the
+ * screen : the number of visible balls drawn in full and as discs is
+ * limited, the rest being points batched with SDL_RenderDrawPoints. The
+ * limits follow the measured frame times, see adaptDetail.
+ */
+class BallRenderer {
+   public:
+      BallRenderer();
+
+      /**
+       * @brief Renders the visible balls at their interpolated pose
+       *
+       * @param renderer the SDL_Renderer
+       * @param balls states published by the simulation
+       * @param visible indices in <balls> of the balls to draw
+       * @param viewport area <visible> was gathered for
+       * @param transform from the world to the screen, a uniform scale and
+       * a translation
+       * @param alpha interpolation factor between the previous and the
+       * current poses
+       */
+      void render(SDL_Renderer* renderer, const BallArrays& balls, const std::vector<unsigned>& visible,
+                  cpBB viewport, cpTransform transform, cpFloat alpha);
+
+      // Releases the atlas, must be called before the renderer is destroyed
+      void free();
+
+      void setMode(RenderMode mode) { _mode = mode; }
+      RenderMode getMode() const { return _mode; }
+      static const char* getModeName(RenderMode mode);
+
+      /**
+       * @brief Lowers the level of detail when frames take longer than
+       * <budget>, and tries a higher one again once they have kept within
+       * it for a while. To be called once per frame.
+       *
+       * @param frameSeconds duration of the work of the last frame, without
+       * the wait for the vertical sync
+       * @param budget duration of a frame at the target frame rate
+       */
+      void adaptDetail(double frameSeconds, double budget);
+
+      // Level of detail of the balls at the last render, smaller balls may
+      // be drawn with less
+      DetailLevel getDetailLevel() const { return _level; }
+      static const char* getDetailLevelName(DetailLevel level);
+
+      // Uses the vectorized stages when the processor supports them, off by
+      // default as the simd setting of the simulation
+      void setSimd(bool simd) { _simd = simd && hasSimdSupport(); }
+
+   private:
+      // Segments used to approximate a circle
+      static const int CIRCLE_SEGMENTS = 32;
+      static const int ATLAS_SIZE = 1024;
+      // Points are grouped by color, 2 bits per channel
+      static const int POINT_COLORS = 64;
+
+      // Atlas areas of the two layers of a ball of a given radius
+      typedef struct ball_sprite_t {
+         SDL_Rect fill;     // white disc, tinted with the ball color
+         SDL_Rect outline;  // outline, axes and center, drawn as is
+      } BallSprite;
+
+      // Triangles drawn with one SDL_RenderGeometry call, and points drawn
+      // with one SDL_RenderDrawPoints call per color
+      typedef struct geometry_batch_t {
+         std::vector<SDL_Vertex> vertices;
+         std::vector<int> indices;
+         std::vector<SDL_FPoint> points[POINT_COLORS];
+      } GeometryBatch;
+
+      /**
+       * @brief Blends the previous and current poses of every visible ball,
+       * the positions are then on the screen, and computes the rotations of
+       * all of them in one pass
+       */
+      void interpolate(const BallArrays& balls, const std::vector<unsigned>& visible, cpTransform transform,
+                       cpFloat alpha);
+
+      /**
+       * @brief Level of detail of a ball of <radius> screen pixels, never
+       * above the one of the number of visible balls
+       */
+      DetailLevel getDetailLevel(cpFloat radius) const;
+
+      /**
+       * @brief Renders a ball with SDL2_gfx primitives, points are added to
+       * <_awakeBatch>
+       */
+      void renderGfx(SDL_Renderer* renderer, cpVect position, cpVect rotation, cpFloat radius, Color color);
+
+      void renderSprites(SDL_Renderer* renderer, const BallArrays& balls, const std::vector<unsigned>& visible,
+                         cpFloat scale);
+
+      /**
+       * @brief Gives the sprites of a ball of <radius>, rasterizing them into
+       * the atlas the first time
+       *
+       * @return NULL if the atlas is full
+       */
+      const BallSprite* getSprite(SDL_Renderer* renderer, int radius);
+
+      // Reserves a <size> x <size> square in the atlas
+      bool allocateAtlasRect(int size, SDL_Rect* rect);
+
+      void renderGeometry(SDL_Renderer* renderer, const BallArrays& balls, const std::vector<unsigned>& visible,
+                          cpBB viewport, cpTransform transform);
+
+      /**
+       * @brief Appends the triangles of a ball, or its point, to <batch>, in
+       * screen pixels
+       */
+      void addBall(GeometryBatch* batch, cpVect position, cpVect rotation, cpFloat radius, Color color);
+
+      static void addPoint(GeometryBatch* batch, cpVect position, Color color);
+
+      static void clearBatch(GeometryBatch* batch);
+
+      /**
+       * @brief Appends to <batch> a quad of <width> pixels going from <a> to
+       * <b>
+       */
+      static void addLine(GeometryBatch* batch, cpVect a, cpVect b, float width, SDL_Color color);
+
+      // Appends a vertex to <batch> and returns its index
+      static int addVertex(GeometryBatch* batch, cpFloat x, cpFloat y, SDL_Color color);
+
+      static void drawBatch(SDL_Renderer* renderer, const GeometryBatch& batch);
+
+      RenderMode _mode;
+      cpVect _unitCircle[CIRCLE_SEGMENTS];
+
+      Texture _atlas;
+      std::map<int, BallSprite> _sprites;
+      // Shelf packing cursor in the atlas
+      int _atlasX, _atlasY, _atlasRowHeight;
+
+      // Kept between frames so that their memory is reused, one pose per
+      // visible ball, the angles being in [-pi, pi]
+      std::vector<cpVect> _positions;
+      std::vector<float> _angles, _cosines, _sines;
+      GeometryBatch _awakeBatch;
+      // Visible sleeping balls, built for the version <_asleepVersion> of
+      // the set, for the viewport <_asleepViewport>, the transform
+      // <_asleepTransform> and the level of detail <_asleepLevel>
+      GeometryBatch _asleepBatch;
+      unsigned long _asleepVersion;
+      cpBB _asleepViewport;
+      cpTransform _asleepTransform;
+      DetailLevel _asleepLevel;
+
+      // Most visible balls drawn at each level, the others get the next one
+      unsigned _detailLimits[NB_DETAIL_LEVELS - 1];
+      DetailLevel _level;
+      unsigned _visibleCount;
+      // Consecutive frames over the budget, and frames since the limits
+      // last changed
+      int _slowFrames, _stableFrames;
+      // Frames within the budget before a higher level is tried, doubled
+      // whenever the last try did not hold
+      int _raiseDelay;
+      bool _raised;
+
+      // Whether the rotations are computed with the vectorized path
+      bool _simd;
+};
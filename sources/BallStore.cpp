@@ -0,0 +1,160 @@
+#include "BallStore.h"
+
+Handle BallStore::add(cpSpace* space, cpVect position, int mass, int radius, Color color) {
+   // Moment of inertia
+   cpFloat moment = cpMomentForCircle(mass, 0, radius, cpvzero);
+
+   Handle ball = _slots.insert();
+
+   // Ball body and its collision shape
+   cpBody* body;
+   cpShape* shape;
+   _pool.acquire(mass, moment, radius, &body, &shape);
+
+   cpSpaceAddBody(space, body);
+   cpBodySetPosition(body, position);
+
+   cpSpaceAddShape(space, shape);
+   cpShapeSetFriction(shape, 0.7);
+   cpShapeSetElasticity(shape, 0);
+   cpShapeSetFilter(shape, cpShapeFilterNew(CP_NO_GROUP, BALL_CATEGORY, CP_ALL_CATEGORIES));
+   cpShapeSetUserData(shape, (cpDataPointer) (uintptr_t) ball.index);
+   cpBodySetUserData(body, (cpDataPointer) (uintptr_t) _bodies.size());
+
+   _arrays.positions.push_back(position);
+   _arrays.previousPositions.push_back(position);
+   _arrays.angles.push_back(0);
+   _arrays.previousAngles.push_back(0);
+   _arrays.radii.push_back(radius);
+   _arrays.colors.push_back(color);
+   _arrays.asleep.push_back(0);
+   ++ _awakeCount;
+   _masses.push_back(mass);
+   _bodies.push_back(body);
+   _shapes.push_back(shape);
+
+   return ball;
+}
+
+void BallStore::addMany(cpSpace* space, const std::vector<BallSpawn>& balls) {
+   _pool.prepare(balls.size());
+   for (unsigned i = 0; i < balls.size(); i++)
+      add(space, balls[i].position, balls[i].mass, balls[i].radius, balls[i].color);
+}
+
+void BallStore::reserve(unsigned count) {
+   _slots.reserve(count);
+   _arrays.positions.reserve(count);
+   _arrays.previousPositions.reserve(count);
+   _arrays.angles.reserve(count);
+   _arrays.previousAngles.reserve(count);
+   _arrays.radii.reserve(count);
+   _arrays.colors.reserve(count);
+   _arrays.asleep.reserve(count);
+   _masses.reserve(count);
+   _bodies.reserve(count);
+   _shapes.reserve(count);
+}
+
+void BallStore::remove(cpSpace* space, Handle ball) {
+   unsigned hole, last;
+   if (!_slots.remove(ball, &hole, &last))
+      return;
+
+   if (_arrays.asleep[hole])
+      ++ _arrays.asleepVersion;
+   else
+      -- _awakeCount;
+   cpSpaceRemoveShape(space, _shapes[hole]);
+   cpSpaceRemoveBody(space, _bodies[hole]);
+   _pool.release(_bodies[hole]);
+
+   move(last, hole);
+   popBack();
+}
+
+void BallStore::clear() {
+   _pool.releaseAll();
+   _slots.clear();
+   _arrays.positions.clear();
+   _arrays.previousPositions.clear();
+   _arrays.angles.clear();
+   _arrays.previousAngles.clear();
+   _arrays.radii.clear();
+   _arrays.colors.clear();
+   _arrays.asleep.clear();
+   ++ _arrays.asleepVersion;
+   _masses.clear();
+   _bodies.clear();
+   _shapes.clear();
+   _awakeCount = 0;
+}
+
+void BallStore::savePreviousState() {
+   _arrays.previousPositions = _arrays.positions;
+   _arrays.previousAngles = _arrays.angles;
+}
+
+void BallStore::readBack(cpSpace* space) {
+   // The dynamic bodies of the space are the awake ones, they are marked
+   // with 2 while being read. The user data of a body is its index, other
+   // bodies of the space do not match the body at that index.
+   std::vector<uint8_t>& asleep = _arrays.asleep;
+   bool changed = false;
+   _awakeCount = 0;
+   cpArray* bodies = space->dynamicBodies;
+   for (int i = 0; i < bodies->num; i++) {
+      cpBody* body = (cpBody*) bodies->arr[i];
+      unsigned index = (uintptr_t) cpBodyGetUserData(body);
+      if (index >= _bodies.size() || _bodies[index] != body)
+         continue;
+
+      _arrays.positions[index] = cpBodyGetPosition(body);
+      _arrays.angles[index] = cpBodyGetAngle(body);
+      changed |= asleep[index] == 1;
+      asleep[index] = 2;
+      ++ _awakeCount;
+   }
+
+   // Balls left unmarked sleep. The ones which just fell asleep moved
+   // during their last step and are read a last time.
+   for (unsigned i = 0; i < asleep.size(); i++) {
+      if (asleep[i] == 2)
+         asleep[i] = 0;
+      else if (asleep[i] == 0) {
+         _arrays.positions[i] = cpBodyGetPosition(_bodies[i]);
+         _arrays.angles[i] = cpBodyGetAngle(_bodies[i]);
+         asleep[i] = 1;
+         changed = true;
+      }
+   }
+   if (changed)
+      ++ _arrays.asleepVersion;
+}
+
+void BallStore::move(unsigned from, unsigned to) {
+   _arrays.positions[to] = _arrays.positions[from];
+   _arrays.previousPositions[to] = _arrays.previousPositions[from];
+   _arrays.angles[to] = _arrays.angles[from];
+   _arrays.previousAngles[to] = _arrays.previousAngles[from];
+   _arrays.radii[to] = _arrays.radii[from];
+   _arrays.colors[to] = _arrays.colors[from];
+   _arrays.asleep[to] = _arrays.asleep[from];
+   _masses[to] = _masses[from];
+   _bodies[to] = _bodies[from];
+   _shapes[to] = _shapes[from];
+   cpBodySetUserData(_bodies[to], (cpDataPointer) (uintptr_t) to);
+}
+
+void BallStore::popBack() {
+   _arrays.positions.pop_back();
+   _arrays.previousPositions.pop_back();
+   _arrays.angles.pop_back();
+   _arrays.previousAngles.pop_back();
+   _arrays.radii.pop_back();
+   _arrays.colors.pop_back();
+   _arrays.asleep.pop_back();
+   _masses.pop_back();
+   _bodies.pop_back();
+   _shapes.pop_back();
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include "chipmunk/chipmunk.h"
+#include "Ball.h"
+#include "SlotMap.h"
+#include "BodyPool.h"
+
+// Collision categories, queries filter the walls out with them
+const cpBitmask BALL_CATEGORY = 1 << 0;
+const cpBitmask WALL_CATEGORY = 1 << 1;
+
+// Ball to be added by BallStore::addMany
+typedef struct ball_spawn_t {
+   cpVect position;
+   int mass, radius;
+   Color color;
+} BallSpawn;
+
+// Poses and looks of a set of balls, one contiguous array per field
+typedef struct ball_arrays_t {
+   std::vector<cpVect> positions, previousPositions;
+   std::vector<cpFloat> angles, previousAngles;
+   std::vector<int> radii;
+   std::vector<Color> colors;
+   // 1 for the balls whose body sleeps, their poses do not change
+   std::vector<uint8_t> asleep;
+   // Changed whenever the set of sleeping balls changes
+   unsigned long asleepVersion = 0;
+
+   unsigned size() const { return positions.size(); }
+} BallArrays;
+
+/**
+ * @brief Structure-of-arrays storage of the balls and of their chipmunk
+ * objects. Passes over the balls stream through the arrays instead of
+ * chasing one heap allocation per ball. Bodies and shapes come from a
+ * BodyPool. Entries are referred to by handles, removal moves the last
+ * entry into the hole.
+ */
+class BallStore {
+   public:
+      BallStore(): _awakeCount(0) {}
+
+      /**
+       * @brief Creates a ball, its body and its shape and adds them to the
+       * space. The user data of the shape is the slot of the ball, see
+       * getHandle(const cpShape*), the one of the body is its index.
+       *
+       * @return handle of the new ball
+       */
+      Handle add(cpSpace* space, cpVect position, int mass, int radius, Color color);
+
+      /**
+       * @brief Adds <balls> in a row, with bodies and shapes next to each
+       * other in the pool
+       */
+      void addMany(cpSpace* space, const std::vector<BallSpawn>& balls);
+
+      // Makes room for <count> balls, before adding many of them at once
+      void reserve(unsigned count);
+
+      // Removes a ball from the space and frees its body and shape
+      void remove(cpSpace* space, Handle ball);
+
+      /**
+       * @brief Forgets every ball at once, without removing them from their
+       * space. The space must be freed right after.
+       */
+      void clear();
+
+      // Remembers the current poses, to be called right before each step
+      void savePreviousState();
+
+      /**
+       * @brief Reads the poses back from the bodies, to be called after each
+       * step. Only the awake bodies of <space> are read, sleeping ones keep
+       * the pose they fell asleep with.
+       */
+      void readBack(cpSpace* space);
+
+      unsigned size() const { return _slots.size(); }
+      // Number of balls whose body is awake, as of the last read back
+      unsigned getAwakeCount() const { return _awakeCount; }
+      bool contains(Handle ball) const { return _slots.contains(ball); }
+      int getIndex(Handle ball) const { return _slots.getDenseIndex(ball); }
+      Handle getHandle(unsigned index) const { return _slots.getHandle(index); }
+
+      // Handle of the ball of <shape>, which must be a ball shape of the store
+      Handle getHandle(const cpShape* shape) const {
+         return _slots.getSlotHandle((uint32_t) (uintptr_t) cpShapeGetUserData(shape));
+      }
+
+      const BallArrays& getArrays() const { return _arrays; }
+      int getMass(unsigned index) const { return _masses[index]; }
+      cpBody* getBody(unsigned index) const { return _bodies[index]; }
+      cpShape* getShape(unsigned index) const { return _shapes[index]; }
+
+   private:
+      // Copies the entry at <from> over the one at <to>
+      void move(unsigned from, unsigned to);
+      // Drops the last entry of every array
+      void popBack();
+
+      SlotMap _slots;
+      BodyPool _pool;
+      BallArrays _arrays;
+      std::vector<int> _masses;
+      std::vector<cpBody*> _bodies;
+      std::vector<cpShape*> _shapes;
+      unsigned _awakeCount;
+};
@@ -0,0 +1,49 @@
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include "BodyPool.h"
+
+BodyPool::~BodyPool() {
+   for (unsigned i = 0; i < _slabs.size(); i++)
+      cpfree(_slabs[i]);
+}
+
+void BodyPool::acquire(cpFloat mass, cpFloat moment, cpFloat radius, cpBody** body, cpShape** shape) {
+   PooledBall* entry;
+   if (!_free.empty()) {
+      entry = _free.back();
+      _free.pop_back();
+   } else {
+      if (_used == _slabs.size() * SLAB_SIZE)
+         _slabs.push_back((PooledBall*) cpcalloc(SLAB_SIZE, sizeof(PooledBall)));
+      entry = &_slabs[_used / SLAB_SIZE][_used % SLAB_SIZE];
+      ++ _used;
+   }
+
+   // The init functions expect zeroed memory, like the one of cpBodyAlloc
+   memset(entry, 0, sizeof(PooledBall));
+   *body = cpBodyInit(&entry->body, mass, moment);
+   *shape = (cpShape*) cpCircleShapeInit(&entry->shape, *body, radius, cpvzero);
+}
+
+void BodyPool::prepare(unsigned count) {
+   // Entries are taken from the back of the free list
+   std::sort(_free.begin(), _free.end(), std::greater<PooledBall*>());
+   if (count <= _free.size())
+      return;
+   unsigned needed = _used + count - _free.size();
+   while (_slabs.size() * SLAB_SIZE < needed)
+      _slabs.push_back((PooledBall*) cpcalloc(SLAB_SIZE, sizeof(PooledBall)));
+}
+
+void BodyPool::release(cpBody* body) {
+   PooledBall* entry = (PooledBall*) body;
+   cpShapeDestroy((cpShape*) &entry->shape);
+   cpBodyDestroy(&entry->body);
+   _free.push_back(entry);
+}
+
+void BodyPool::releaseAll() {
+   _free.clear();
+   _used = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include "chipmunk/chipmunk.h"
+#include "chipmunk/chipmunk_structs.h"
+
+/**
+ * @brief Pool of ball bodies and circle shapes. Each body is stored next to
+ * its shape in slabs of SLAB_SIZE entries, which are never given back to
+ * the system : released entries are reused by the next balls, and the
+ * whole pool can be emptied at once.
+ */
+class BodyPool {
+   public:
+      static const int SLAB_SIZE = 1024;
+
+      BodyPool(): _used(0) {}
+      ~BodyPool();
+
+      /**
+       * @brief Initializes a body and a circle shape attached to it from a
+       * pool entry, with cpBodyInit and cpCircleShapeInit
+       *
+       * @param body receives the body
+       * @param shape receives the shape
+       */
+      void acquire(cpFloat mass, cpFloat moment, cpFloat radius, cpBody** body, cpShape** shape);
+
+      /**
+       * @brief Readies the pool for <count> balls acquired in a row : the
+       * released entries are handed out in the order of their addresses, and
+       * slabs are allocated for the others, so that the balls end up next to
+       * each other in memory
+       */
+      void prepare(unsigned count);
+
+      /**
+       * @brief Destroys a body acquired from the pool and its shape, and
+       * gives their entry back. Both must have been removed from their space.
+       */
+      void release(cpBody* body);
+
+      /**
+       * @brief Gives every entry back at once, without destroying them. Only
+       * valid when none of the bodies is referenced anymore, typically after
+       * their space has been freed.
+       */
+      void releaseAll();
+
+   private:
+      typedef struct pooled_ball_t {
+         cpBody body;  // first, so that a body pointer is an entry pointer
+         cpCircleShape shape;
+      } PooledBall;
+
+      std::vector<PooledBall*> _slabs;
+      // Released entries, reused first
+      std::vector<PooledBall*> _free;
+      // Number of entries handed out from the slabs, in order
+      unsigned _used;
+};
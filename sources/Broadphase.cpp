@@ -0,0 +1,74 @@
+#include <string.h>
+#include "Broadphase.h"
+#include "UniformGrid.h"
+// The private header does not declare its functions as C ones
+extern "C" {
+#include "chipmunk/chipmunk_private.h"
+}
+
+const char* BROADPHASE_NAMES[NB_BROADPHASES] = {"auto", "bbtree", "hash", "sweep1d", "grid"};
+
+/**
+ * @brief Velocity used by the BB-tree to extend the boxes of moving shapes,
+ * as cpSpaceNew does
+ */
+cpVect shapeVelocity(cpShape* shape);
+
+/**
+ * @brief cpSpatialIndexEach callback inserting <shape> into another index
+ */
+void copyShape(cpShape* shape, cpSpatialIndex* index);
+
+cpVect shapeVelocity(cpShape* shape) {
+   return shape->body->v;
+}
+
+void copyShape(cpShape* shape, cpSpatialIndex* index) {
+   cpSpatialIndexInsert(index, shape, shape->hashid);
+}
+
+const char* getBroadphaseName(Broadphase broadphase) {
+   return BROADPHASE_NAMES[broadphase];
+}
+
+bool parseBroadphase(const char* name, Broadphase* broadphase) {
+   for (int i = 0; i < NB_BROADPHASES; i++) {
+      if (strcmp(name, BROADPHASE_NAMES[i]) == 0) {
+         *broadphase = (Broadphase) i;
+         return true;
+      }
+   }
+   return false;
+}
+
+void useBroadphase(cpSpace* space, Broadphase broadphase, cpFloat cellSize, int cellCount, cpBB bounds) {
+   // Both indices are rebuilt, as cpSpaceUseSpatialHash does : a BB-tree
+   // keeps its pairs with the static shapes in the leaves of the static
+   // index too. The static shapes, the walls, always go in a BB-tree.
+   cpSpatialIndexBBFunc bbFunc = (cpSpatialIndexBBFunc) cpShapeGetBB;
+   cpSpatialIndex* staticIndex = cpBBTreeNew(bbFunc, NULL);
+   cpSpatialIndex* dynamicIndex;
+   switch (broadphase) {
+      case BROADPHASE_HASH:
+         dynamicIndex = cpSpaceHashNew(cellSize, cellCount, bbFunc, staticIndex);
+         break;
+      case BROADPHASE_SWEEP:
+         dynamicIndex = cpSweep1DNew(bbFunc, staticIndex);
+         break;
+      case BROADPHASE_GRID:
+         dynamicIndex = uniformGridNew(bounds, cellSize, bbFunc, staticIndex);
+         break;
+      default:
+         dynamicIndex = cpBBTreeNew(bbFunc, staticIndex);
+         cpBBTreeSetVelocityFunc(dynamicIndex, (cpBBTreeVelocityFunc) shapeVelocity);
+         break;
+   }
+
+   cpSpatialIndexEach(space->staticShapes, (cpSpatialIndexIteratorFunc) copyShape, staticIndex);
+   cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc) copyShape, dynamicIndex);
+
+   cpSpatialIndexFree(space->staticShapes);
+   cpSpatialIndexFree(space->dynamicShapes);
+   space->staticShapes = staticIndex;
+   space->dynamicShapes = dynamicIndex;
+}
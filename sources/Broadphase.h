@@ -0,0 +1,32 @@
+#pragma once
+#include "chipmunk/chipmunk.h"
+
+// Spatial indices the dynamic shapes of a space can be stored in
+enum Broadphase {
+   BROADPHASE_AUTO,    // measures the others on the running scene
+   BROADPHASE_BBTREE,  // chipmunk default, cpBBTree
+   BROADPHASE_HASH,    // cpSpaceHash, suited to shapes of similar sizes
+   BROADPHASE_SWEEP,   // cpSweep1D, sort and sweep along the x axis
+   BROADPHASE_GRID,    // uniformGridNew, dense grid for balls of equal radii
+   NB_BROADPHASES
+};
+
+const char* getBroadphaseName(Broadphase broadphase);
+
+/**
+ * @brief Reads a broadphase from its name
+ *
+ * @return false <name> is not a broadphase name
+ */
+bool parseBroadphase(const char* name, Broadphase* broadphase);
+
+/**
+ * @brief Replaces the index of the dynamic shapes of <space> by a new one of
+ * type <broadphase>, with the shapes already in the space. Must not be
+ * called during a step, BROADPHASE_AUTO is not an index.
+ *
+ * @param cellSize size of the cells of the hash or of the grid
+ * @param cellCount number of cells of the hash
+ * @param bounds area covered by the grid
+ */
+void useBroadphase(cpSpace* space, Broadphase broadphase, cpFloat cellSize, int cellCount, cpBB bounds);
@@ -0,0 +1,42 @@
+#include "Camera.h"
+
+// Bounds of the zoom, in screen pixels per world unit
+const cpFloat MIN_ZOOM = 1.0 / 64;
+const cpFloat MAX_ZOOM = 16;
+
+Camera::Camera(int screenWidth, int screenHeight):
+   _screenWidth(screenWidth), _screenHeight(screenHeight),
+   _center(cpv(screenWidth / 2.0, screenHeight / 2.0)), _zoom(1) {
+}
+
+void Camera::fit(cpBB world) {
+   _center = cpBBCenter(world);
+   _zoom = cpfmin(_screenWidth / (world.r - world.l), _screenHeight / (world.t - world.b));
+   _zoom = cpfclamp(_zoom, MIN_ZOOM, MAX_ZOOM);
+}
+
+void Camera::pan(cpVect delta) {
+   _center = cpvsub(_center, cpvmult(delta, 1 / _zoom));
+}
+
+void Camera::zoomAt(cpVect screenPoint, cpFloat factor) {
+   cpVect anchor = toWorld(screenPoint);
+   _zoom = cpfclamp(_zoom * factor, MIN_ZOOM, MAX_ZOOM);
+   // Moves the center so that the anchor is back under the screen point
+   cpVect offset = cpvsub(screenPoint, cpv(_screenWidth / 2.0, _screenHeight / 2.0));
+   _center = cpvsub(anchor, cpvmult(offset, 1 / _zoom));
+}
+
+cpTransform Camera::getTransform() const {
+   // Center to the origin, scale, origin to the middle of the screen
+   return cpTransformMult(cpTransformTranslate(cpv(_screenWidth / 2.0, _screenHeight / 2.0)),
+                          cpTransformMult(cpTransformScale(_zoom, _zoom), cpTransformTranslate(cpvneg(_center))));
+}
+
+cpVect Camera::toWorld(cpVect screenPoint) const {
+   return cpTransformPoint(cpTransformInverse(getTransform()), screenPoint);
+}
+
+cpBB Camera::getViewport() const {
+   return cpTransformbBB(cpTransformInverse(getTransform()), cpBBNew(0, 0, _screenWidth, _screenHeight));
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "chipmunk/chipmunk.h"
+
+/**
+ * @brief View of the world on the screen : the world point shown at the
+ * middle of the screen and the number of screen pixels per world unit. The
+ * whole view is a single cpTransform from the world to the screen, applied
+ * when drawing, so that the world can be larger than the screen.
+ */
+class Camera {
+   public:
+      Camera(int screenWidth, int screenHeight);
+
+      // Centers <world> on the screen, as large as it fits
+      void fit(cpBB world);
+
+      // Drags the world by <delta> screen pixels, as with the mouse
+      void pan(cpVect delta);
+
+      /**
+       * @brief Multiplies the zoom by <factor>, keeping the world point under
+       * <screenPoint> where it is on the screen
+       */
+      void zoomAt(cpVect screenPoint, cpFloat factor);
+
+      // Shows <center> at the middle of the screen, to follow a moving point
+      void setCenter(cpVect center) { _center = center; }
+
+      cpVect getCenter() const { return _center; }
+      cpFloat getZoom() const { return _zoom; }
+
+      // Transform from the world to the screen
+      cpTransform getTransform() const;
+
+      // World point shown at <screenPoint>
+      cpVect toWorld(cpVect screenPoint) const;
+
+      // Area of the world shown on the screen
+      cpBB getViewport() const;
+
+   private:
+      const int _screenWidth, _screenHeight;
+      cpVect _center;
+      cpFloat _zoom;
+};
@@ -0,0 +1,193 @@
+#include <immintrin.h>
+#include "CircleSimd.h"
+#include "chipmunk/chipmunk_structs.h"
+
+// Body fields loaded into one register per field, lane i for arbiter i. The
+// operations follow cpArbiterApplyImpulse one by one, in the same order.
+typedef struct body_lanes_t {
+   __m256d vx, vy, w, vBiasX, vBiasY, wBias, mInv, iInv;
+} BodyLanes;
+
+/**
+ * @brief Loads the velocities and masses of <bodies> into lanes
+ */
+__attribute__((target("avx2"))) BodyLanes loadBodies(cpBody** bodies);
+
+/**
+ * @brief Exact negation of the lanes of <x>, as the unary minus
+ */
+__attribute__((target("avx2"))) inline __m256d negate(__m256d x) {
+   return _mm256_xor_pd(x, _mm256_set1_pd(-0.0));
+}
+
+/**
+ * @brief Stores the velocities of <lanes> back into <bodies>
+ */
+__attribute__((target("avx2"))) void storeBodies(const BodyLanes& lanes, cpBody** bodies);
+
+// The vectorized functions clear the upper halves of the registers before
+// returning or running scalar code. The compiler only does it when
+// optimizing, and without it every scalar instruction or call to an inline
+// function of chipmunk, not inlined then, pays for the transition.
+
+// Lanes made of the same field of 4 structures
+#define GATHER(array, field) _mm256_set_pd((array)[3]->field, (array)[2]->field, (array)[1]->field, (array)[0]->field)
+
+bool hasSimdSupport() {
+   return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2"))) void findCircleOverlaps(const CirclePair* pairs, unsigned count, uint8_t* overlaps) {
+   unsigned i = 0;
+   for (; i + SIMD_WIDTH <= count; i += SIMD_WIDTH) {
+      cpCircleShape* a[SIMD_WIDTH];
+      cpCircleShape* b[SIMD_WIDTH];
+      for (int k = 0; k < SIMD_WIDTH; k++) {
+         a[k] = (cpCircleShape*) pairs[i + k].a;
+         b[k] = (cpCircleShape*) pairs[i + k].b;
+      }
+
+      // distsq < mindist * mindist, as in CircleToCircle
+      __m256d minDist = _mm256_add_pd(GATHER(a, r), GATHER(b, r));
+      __m256d dx = _mm256_sub_pd(GATHER(b, tc.x), GATHER(a, tc.x));
+      __m256d dy = _mm256_sub_pd(GATHER(b, tc.y), GATHER(a, tc.y));
+      __m256d distSq = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+      int mask = _mm256_movemask_pd(_mm256_cmp_pd(distSq, _mm256_mul_pd(minDist, minDist), _CMP_LT_OQ));
+      for (int k = 0; k < SIMD_WIDTH; k++)
+         overlaps[i + k] = (mask >> k) & 1;
+   }
+   _mm256_zeroupper();
+
+   for (; i < count; i++) {
+      cpCircleShape* a = (cpCircleShape*) pairs[i].a;
+      cpCircleShape* b = (cpCircleShape*) pairs[i].b;
+      cpFloat minDist = a->r + b->r;
+      overlaps[i] = cpvlengthsq(cpvsub(b->tc, a->tc)) < minDist * minDist;
+   }
+}
+
+__attribute__((target("avx2"))) BodyLanes loadBodies(cpBody** bodies) {
+   BodyLanes lanes;
+   lanes.vx = GATHER(bodies, v.x);
+   lanes.vy = GATHER(bodies, v.y);
+   lanes.w = GATHER(bodies, w);
+   lanes.vBiasX = GATHER(bodies, v_bias.x);
+   lanes.vBiasY = GATHER(bodies, v_bias.y);
+   lanes.wBias = GATHER(bodies, w_bias);
+   lanes.mInv = GATHER(bodies, m_inv);
+   lanes.iInv = GATHER(bodies, i_inv);
+   return lanes;
+}
+
+__attribute__((target("avx2"))) void storeBodies(const BodyLanes& lanes, cpBody** bodies) {
+   double vx[SIMD_WIDTH], vy[SIMD_WIDTH], w[SIMD_WIDTH];
+   double vBiasX[SIMD_WIDTH], vBiasY[SIMD_WIDTH], wBias[SIMD_WIDTH];
+   _mm256_storeu_pd(vx, lanes.vx);
+   _mm256_storeu_pd(vy, lanes.vy);
+   _mm256_storeu_pd(w, lanes.w);
+   _mm256_storeu_pd(vBiasX, lanes.vBiasX);
+   _mm256_storeu_pd(vBiasY, lanes.vBiasY);
+   _mm256_storeu_pd(wBias, lanes.wBias);
+
+   // Lanes sharing a static body write it back unchanged, its inverse
+   // masses are zero. The fields are set one by one, without calling cpv.
+   for (int k = 0; k < SIMD_WIDTH; k++) {
+      bodies[k]->v.x = vx[k];
+      bodies[k]->v.y = vy[k];
+      bodies[k]->w = w[k];
+      bodies[k]->v_bias.x = vBiasX[k];
+      bodies[k]->v_bias.y = vBiasY[k];
+      bodies[k]->w_bias = wBias[k];
+   }
+}
+
+__attribute__((target("avx2"))) void applyImpulses4(cpArbiter** arbiters) {
+   cpBody* bodiesA[SIMD_WIDTH];
+   cpBody* bodiesB[SIMD_WIDTH];
+   cpContact* contacts[SIMD_WIDTH];
+   for (int k = 0; k < SIMD_WIDTH; k++) {
+      bodiesA[k] = arbiters[k]->body_a;
+      bodiesB[k] = arbiters[k]->body_b;
+      contacts[k] = arbiters[k]->contacts;
+   }
+
+   BodyLanes a = loadBodies(bodiesA);
+   BodyLanes b = loadBodies(bodiesB);
+   __m256d nx = GATHER(arbiters, n.x), ny = GATHER(arbiters, n.y);
+   __m256d surfaceX = GATHER(arbiters, surface_vr.x), surfaceY = GATHER(arbiters, surface_vr.y);
+   __m256d friction = GATHER(arbiters, u);
+   __m256d r1x = GATHER(contacts, r1.x), r1y = GATHER(contacts, r1.y);
+   __m256d r2x = GATHER(contacts, r2.x), r2y = GATHER(contacts, r2.y);
+   __m256d nMass = GATHER(contacts, nMass), tMass = GATHER(contacts, tMass);
+   __m256d bias = GATHER(contacts, bias), bounce = GATHER(contacts, bounce);
+   __m256d jBiasOld = GATHER(contacts, jBias);
+   __m256d jnOld = GATHER(contacts, jnAcc), jtOld = GATHER(contacts, jtAcc);
+   __m256d zero = _mm256_setzero_pd();
+
+   // vb1 = a->v_bias + perp(r1) * a->w_bias, vb2 likewise
+   __m256d vb1x = _mm256_add_pd(a.vBiasX, _mm256_mul_pd(negate(r1y), a.wBias));
+   __m256d vb1y = _mm256_add_pd(a.vBiasY, _mm256_mul_pd(r1x, a.wBias));
+   __m256d vb2x = _mm256_add_pd(b.vBiasX, _mm256_mul_pd(negate(r2y), b.wBias));
+   __m256d vb2y = _mm256_add_pd(b.vBiasY, _mm256_mul_pd(r2x, b.wBias));
+
+   // vr = relative_velocity(a, b, r1, r2) + surface_vr
+   __m256d v1x = _mm256_add_pd(a.vx, _mm256_mul_pd(negate(r1y), a.w));
+   __m256d v1y = _mm256_add_pd(a.vy, _mm256_mul_pd(r1x, a.w));
+   __m256d v2x = _mm256_add_pd(b.vx, _mm256_mul_pd(negate(r2y), b.w));
+   __m256d v2y = _mm256_add_pd(b.vy, _mm256_mul_pd(r2x, b.w));
+   __m256d vrx = _mm256_add_pd(_mm256_sub_pd(v2x, v1x), surfaceX);
+   __m256d vry = _mm256_add_pd(_mm256_sub_pd(v2y, v1y), surfaceY);
+
+   __m256d vbn = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(vb2x, vb1x), nx),
+                               _mm256_mul_pd(_mm256_sub_pd(vb2y, vb1y), ny));
+   __m256d vrn = _mm256_add_pd(_mm256_mul_pd(vrx, nx), _mm256_mul_pd(vry, ny));
+   __m256d vrt = _mm256_add_pd(_mm256_mul_pd(vrx, negate(ny)), _mm256_mul_pd(vry, nx));
+
+   // Accumulated impulses, clamped
+   __m256d jbn = _mm256_mul_pd(_mm256_sub_pd(bias, vbn), nMass);
+   __m256d jBias = _mm256_max_pd(_mm256_add_pd(jBiasOld, jbn), zero);
+
+   __m256d jn = _mm256_mul_pd(negate(_mm256_add_pd(bounce, vrn)), nMass);
+   __m256d jnAcc = _mm256_max_pd(_mm256_add_pd(jnOld, jn), zero);
+
+   __m256d jtMax = _mm256_mul_pd(friction, jnAcc);
+   __m256d jt = _mm256_mul_pd(negate(vrt), tMass);
+   __m256d jtAcc = _mm256_min_pd(_mm256_max_pd(_mm256_add_pd(jtOld, jt), negate(jtMax)), jtMax);
+
+   // apply_bias_impulses(a, b, r1, r2, n * (jBias - jbnOld))
+   __m256d dBias = _mm256_sub_pd(jBias, jBiasOld);
+   __m256d jx = _mm256_mul_pd(nx, dBias), jy = _mm256_mul_pd(ny, dBias);
+   __m256d njx = negate(jx), njy = negate(jy);
+   a.vBiasX = _mm256_add_pd(a.vBiasX, _mm256_mul_pd(njx, a.mInv));
+   a.vBiasY = _mm256_add_pd(a.vBiasY, _mm256_mul_pd(njy, a.mInv));
+   a.wBias = _mm256_add_pd(a.wBias, _mm256_mul_pd(a.iInv, _mm256_sub_pd(_mm256_mul_pd(r1x, njy), _mm256_mul_pd(r1y, njx))));
+   b.vBiasX = _mm256_add_pd(b.vBiasX, _mm256_mul_pd(jx, b.mInv));
+   b.vBiasY = _mm256_add_pd(b.vBiasY, _mm256_mul_pd(jy, b.mInv));
+   b.wBias = _mm256_add_pd(b.wBias, _mm256_mul_pd(b.iInv, _mm256_sub_pd(_mm256_mul_pd(r2x, jy), _mm256_mul_pd(r2y, jx))));
+
+   // apply_impulses(a, b, r1, r2, rotate(n, (jnAcc - jnOld, jtAcc - jtOld)))
+   __m256d dn = _mm256_sub_pd(jnAcc, jnOld), dt = _mm256_sub_pd(jtAcc, jtOld);
+   jx = _mm256_sub_pd(_mm256_mul_pd(nx, dn), _mm256_mul_pd(ny, dt));
+   jy = _mm256_add_pd(_mm256_mul_pd(nx, dt), _mm256_mul_pd(ny, dn));
+   njx = negate(jx);
+   njy = negate(jy);
+   a.vx = _mm256_add_pd(a.vx, _mm256_mul_pd(njx, a.mInv));
+   a.vy = _mm256_add_pd(a.vy, _mm256_mul_pd(njy, a.mInv));
+   a.w = _mm256_add_pd(a.w, _mm256_mul_pd(a.iInv, _mm256_sub_pd(_mm256_mul_pd(r1x, njy), _mm256_mul_pd(r1y, njx))));
+   b.vx = _mm256_add_pd(b.vx, _mm256_mul_pd(jx, b.mInv));
+   b.vy = _mm256_add_pd(b.vy, _mm256_mul_pd(jy, b.mInv));
+   b.w = _mm256_add_pd(b.w, _mm256_mul_pd(b.iInv, _mm256_sub_pd(_mm256_mul_pd(r2x, jy), _mm256_mul_pd(r2y, jx))));
+
+   double jBiasLanes[SIMD_WIDTH], jnLanes[SIMD_WIDTH], jtLanes[SIMD_WIDTH];
+   _mm256_storeu_pd(jBiasLanes, jBias);
+   _mm256_storeu_pd(jnLanes, jnAcc);
+   _mm256_storeu_pd(jtLanes, jtAcc);
+   for (int k = 0; k < SIMD_WIDTH; k++) {
+      contacts[k]->jBias = jBiasLanes[k];
+      contacts[k]->jnAcc = jnLanes[k];
+      contacts[k]->jtAcc = jtLanes[k];
+   }
+   storeBodies(a, bodiesA);
+   storeBodies(b, bodiesB);
+   _mm256_zeroupper();
+}
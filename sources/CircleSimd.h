@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include "chipmunk/chipmunk.h"
+
+// Vectorized paths for the circles, built for AVX2 and only used when the
+// processor supports it. The overlap test gives the same results as
+// chipmunk, the solver follows the same model up to rounding.
+
+// Candidate pair of circle shapes found by the broadphase
+typedef struct circle_pair_t {
+   cpShape *a, *b;
+   cpCollisionID id;
+} CirclePair;
+
+// Number of arbiters solved at once by applyImpulses4
+const int SIMD_WIDTH = 4;
+
+// Whether the processor runs the vectorized paths
+bool hasSimdSupport();
+
+/**
+ * @brief Tells which pairs of circles overlap, with the test of chipmunk's
+ * circle to circle collision, SIMD_WIDTH pairs at a time
+ *
+ * @param overlaps set to 1 for the overlapping pairs, 0 for the others
+ */
+void findCircleOverlaps(const CirclePair* pairs, unsigned count, uint8_t* overlaps);
+
+/**
+ * @brief Same as cpArbiterApplyImpulse on SIMD_WIDTH arbiters at once. Each
+ * arbiter must have a single contact, and no dynamic body may be shared
+ * between them.
+ */
+void applyImpulses4(cpArbiter** arbiters);
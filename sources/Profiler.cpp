@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "Profiler.h"
+
+Profiler::Profiler(const std::vector<const char*>& names, unsigned capacity):
+   _names(names), _capacity(capacity > 0 ? capacity : 1),
+   _samples(_names.size() * _capacity), _first(0), _size(0) {
+}
+
+void Profiler::add(const double* values) {
+   unsigned slot = (_first + _size) % _capacity;
+   if (_size < _capacity)
+      ++ _size;
+   else
+      _first = (_first + 1) % _capacity;
+
+   std::copy(values, values + _names.size(), _samples.begin() + slot * _names.size());
+}
+
+double Profiler::get(unsigned index, unsigned counter) const {
+   return _samples[((_first + index) % _capacity) * _names.size() + counter];
+}
+
+double Profiler::getMean(unsigned counter) const {
+   if (_size == 0)
+      return 0;
+   double sum = 0;
+   for (unsigned i = 0; i < _size; i++)
+      sum += get(i, counter);
+   return sum / _size;
+}
+
+double Profiler::getPercentile(unsigned counter, double percentile) const {
+   if (_size == 0)
+      return 0;
+   _sorted.resize(_size);
+   for (unsigned i = 0; i < _size; i++)
+      _sorted[i] = get(i, counter);
+
+   // Smallest value with at least <percentile> percent of the samples at or
+   // under it
+   unsigned rank = (unsigned) ceil(percentile / 100 * _size);
+   rank = std::min(std::max(rank, 1u), _size) - 1;
+   std::nth_element(_sorted.begin(), _sorted.begin() + rank, _sorted.end());
+   return _sorted[rank];
+}
+
+bool Profiler::save(const char* path, double scale) const {
+   FILE* file = fopen(path, "w");
+   if (!file) {
+      fprintf(stderr, "Could not open %s for writing\n", path);
+      return false;
+   }
+   for (unsigned j = 0; j < _names.size(); j++)
+      fprintf(file, "%s%s", _names[j], j + 1 < _names.size() ? "," : "\n");
+   for (unsigned i = 0; i < _size; i++) {
+      for (unsigned j = 0; j < _names.size(); j++)
+         fprintf(file, "%.6f%s", get(i, j) * scale, j + 1 < _names.size() ? "," : "\n");
+   }
+   if (fclose(file) != 0) {
+      fprintf(stderr, "Could not write %s\n", path);
+      return false;
+   }
+   return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+/**
+ * @brief Rolling window over the last samples of a set of counters, such as
+ * the durations of the phases of a frame. Once the window is full, each new
+ * sample replaces the oldest one. Percentiles are computed over the samples
+ * of the window.
+ */
+class Profiler {
+   public:
+      /**
+       * @param names name of each counter, the strings must outlive the
+       * profiler
+       * @param capacity number of samples kept
+       */
+      Profiler(const std::vector<const char*>& names, unsigned capacity);
+
+      // Adds a sample made of one value per counter
+      void add(const double* values);
+
+      unsigned getCounterCount() const { return _names.size(); }
+      const char* getName(unsigned counter) const { return _names[counter]; }
+      unsigned size() const { return _size; }
+      unsigned getCapacity() const { return _capacity; }
+
+      // Value of <counter> in the sample <index>, 0 being the oldest one
+      double get(unsigned index, unsigned counter) const;
+
+      double getMean(unsigned counter) const;
+
+      /**
+       * @brief Value under which <percentile> percent of the samples of
+       * <counter> are, by the nearest rank. 0 if there is no sample.
+       */
+      double getPercentile(unsigned counter, double percentile) const;
+
+      /**
+       * @brief Writes the samples of the window as CSV, one line per sample
+       * from the oldest one, with the values multiplied by <scale>
+       *
+       * @return false the file could not be written
+       */
+      bool save(const char* path, double scale = 1) const;
+
+   private:
+      std::vector<const char*> _names;
+      const unsigned _capacity;
+      // Samples one after the other, <_first> being the oldest one
+      std::vector<double> _samples;
+      unsigned _first, _size;
+      // Kept between calls so that its memory is reused
+      mutable std::vector<double> _sorted;
+};
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include "Recording.h"
+
+// Start of the files, and version of their layout
+const char RECORDING_MAGIC[4] = {'B', 'R', 'E', 'C'};
+const uint32_t RECORDING_VERSION = 2;
+// Recordings of version 1 have no spawn pattern, their balls were random
+const uint32_t RECORDING_VERSION_RANDOM_SPAWN = 1;
+
+const char* SPAWN_PATTERN_NAMES[NB_SPAWN_PATTERNS] = {"random", "grid"};
+
+// Reading position in the content of a file
+typedef struct reader_t {
+   const uint8_t* data;
+   size_t size;
+   size_t position;
+   bool failed;  // set when reading past the end
+} Reader;
+
+// Functions declarations =====================================================
+
+// Appends <value> 7 bits per byte, the high bit tells if more bytes follow
+void writeVarint(std::vector<uint8_t>* buffer, uint64_t value);
+// Signed integers are zigzag encoded so that small negative values stay short
+void writeSigned(std::vector<uint8_t>* buffer, int64_t value);
+
+uint64_t readVarint(Reader* reader);
+int64_t readSigned(Reader* reader);
+
+// Functions definitions ======================================================
+
+void writeVarint(std::vector<uint8_t>* buffer, uint64_t value) {
+   while (value >= 0x80) {
+      buffer->push_back((uint8_t) (value | 0x80));
+      value >>= 7;
+   }
+   buffer->push_back((uint8_t) value);
+}
+
+void writeSigned(std::vector<uint8_t>* buffer, int64_t value) {
+   writeVarint(buffer, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+uint64_t readVarint(Reader* reader) {
+   uint64_t value = 0;
+   for (int shift = 0; shift < 64; shift += 7) {
+      if (reader->position >= reader->size) {
+         reader->failed = true;
+         return 0;
+      }
+      uint8_t byte = reader->data[reader->position++];
+      value |= (uint64_t) (byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+         return value;
+   }
+   reader->failed = true;
+   return 0;
+}
+
+int64_t readSigned(Reader* reader) {
+   uint64_t value = readVarint(reader);
+   return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+const char* getSpawnPatternName(SpawnPattern pattern) {
+   return SPAWN_PATTERN_NAMES[pattern];
+}
+
+bool parseSpawnPattern(const char* name, SpawnPattern* pattern) {
+   for (int i = 0; i < NB_SPAWN_PATTERNS; i++) {
+      if (strcmp(name, SPAWN_PATTERN_NAMES[i]) == 0) {
+         *pattern = (SpawnPattern) i;
+         return true;
+      }
+   }
+   return false;
+}
+
+bool saveRecording(const char* path, const Recording& recording) {
+   std::vector<uint8_t> buffer(RECORDING_MAGIC, RECORDING_MAGIC + sizeof(RECORDING_MAGIC));
+   writeVarint(&buffer, RECORDING_VERSION);
+   writeVarint(&buffer, recording.seed);
+   writeSigned(&buffer, recording.width);
+   writeSigned(&buffer, recording.height);
+   writeVarint(&buffer, recording.spawn);
+   writeVarint(&buffer, recording.commands.size());
+
+   unsigned long step = 0;
+   for (unsigned i = 0; i < recording.commands.size(); i++) {
+      const RecordedCommand& recorded = recording.commands[i];
+      buffer.push_back((uint8_t) recorded.command.type);
+      writeVarint(&buffer, recorded.step - step);
+      writeSigned(&buffer, recorded.command.x);
+      writeSigned(&buffer, recorded.command.y);
+      writeSigned(&buffer, recorded.command.count);
+      step = recorded.step;
+   }
+
+   FILE* file = fopen(path, "wb");
+   if (!file) {
+      fprintf(stderr, "Could not open %s for writing\n", path);
+      return false;
+   }
+   bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+   written = fclose(file) == 0 && written;
+   if (!written)
+      fprintf(stderr, "Could not write %s\n", path);
+   return written;
+}
+
+bool loadRecording(const char* path, Recording* recording) {
+   FILE* file = fopen(path, "rb");
+   if (!file) {
+      fprintf(stderr, "Could not open %s\n", path);
+      return false;
+   }
+   std::vector<uint8_t> buffer;
+   uint8_t chunk[4096];
+   size_t read;
+   while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+      buffer.insert(buffer.end(), chunk, chunk + read);
+   fclose(file);
+
+   if (buffer.size() < sizeof(RECORDING_MAGIC) || memcmp(buffer.data(), RECORDING_MAGIC, sizeof(RECORDING_MAGIC)) != 0) {
+      fprintf(stderr, "%s is not a recording\n", path);
+      return false;
+   }
+   Reader reader = {buffer.data(), buffer.size(), sizeof(RECORDING_MAGIC), false};
+   uint64_t version = readVarint(&reader);
+   if (version != RECORDING_VERSION && version != RECORDING_VERSION_RANDOM_SPAWN) {
+      fprintf(stderr, "%s was recorded by another version\n", path);
+      return false;
+   }
+   recording->seed = (uint32_t) readVarint(&reader);
+   recording->width = (int) readSigned(&reader);
+   recording->height = (int) readSigned(&reader);
+   uint64_t spawn = version == RECORDING_VERSION_RANDOM_SPAWN ? (uint64_t) SPAWN_RANDOM : readVarint(&reader);
+   if (spawn >= NB_SPAWN_PATTERNS)
+      reader.failed = true;
+   recording->spawn = (SpawnPattern) spawn;
+   uint64_t count = readVarint(&reader);
+
+   // Each command takes at least 5 bytes, which bounds the count of a
+   // corrupted file
+   recording->commands.clear();
+   if (count > (reader.size - reader.position) / 5)
+      reader.failed = true;
+   else
+      recording->commands.reserve(count);
+
+   unsigned long step = 0;
+   for (uint64_t i = 0; i < count && !reader.failed; i++) {
+      RecordedCommand recorded;
+      uint8_t type = reader.position < reader.size ? reader.data[reader.position++] : (uint8_t) NB_COMMAND_TYPES;
+      if (type >= NB_COMMAND_TYPES) {
+         reader.failed = true;
+         break;
+      }
+      recorded.command.type = (CommandType) type;
+      step += readVarint(&reader);
+      recorded.step = step;
+      recorded.command.x = (int) readSigned(&reader);
+      recorded.command.y = (int) readSigned(&reader);
+      int64_t commandCount = readSigned(&reader);
+      if (commandCount < 0 || commandCount > MAX_SPAWN_COUNT) {
+         reader.failed = true;
+         break;
+      }
+      recorded.command.count = (int) commandCount;
+      recording->commands.push_back(recorded);
+   }
+
+   if (reader.failed || recording->width <= 0 || recording->height <= 0) {
+      fprintf(stderr, "%s is corrupted\n", path);
+      return false;
+   }
+   return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+// Inputs the render thread sends to the physics thread
+enum CommandType {
+   COMMAND_SPAWN,    // adds <count> balls, around (x, y) if there is only one
+   COMMAND_GRAB,     // links the ball under (x, y) to the mouse
+   COMMAND_DRAG,     // moves the mouse end of the link to (x, y)
+   COMMAND_RELEASE,  // removes the mouse link
+   COMMAND_RESET,    // removes every ball
+   COMMAND_SAVE,     // writes the world into the snapshot file
+   COMMAND_LOAD,     // replaces the world by the one of the snapshot file
+   COMMAND_FOLLOW,   // has the camera follow the ball under (x, y), or none
+   NB_COMMAND_TYPES
+};
+
+// How the balls of a spawn command are placed
+enum SpawnPattern {
+   SPAWN_RANDOM,  // anywhere in the world, overlapping each other
+   SPAWN_GRID,    // in free cells of a grid, jittered, none overlapping
+   NB_SPAWN_PATTERNS
+};
+
+// Most balls a single spawn command may add
+const int MAX_SPAWN_COUNT = 1000000;
+
+typedef struct command_t {
+   CommandType type;
+   int x, y;
+   int count;
+} Command;
+
+// Command and the number of steps taken before it was executed
+typedef struct recorded_command_t {
+   unsigned long step;
+   Command command;
+} RecordedCommand;
+
+/**
+ * @brief Everything needed to run a simulation again : its size, the seed of
+ * its random numbers, how it placed the spawned balls and the commands it
+ * executed, in order
+ */
+typedef struct recording_t {
+   uint32_t seed;
+   int width, height;
+   SpawnPattern spawn;
+   std::vector<RecordedCommand> commands;
+} Recording;
+
+const char* getSpawnPatternName(SpawnPattern pattern);
+
+// @return false <name> is not the name of a spawn pattern
+bool parseSpawnPattern(const char* name, SpawnPattern* pattern);
+
+/**
+ * @brief Writes <recording> to a binary file. Integers are stored as
+ * variable length quantities and steps as the difference with the previous
+ * command, so that a command mostly takes a few bytes.
+ *
+ * @return false the file could not be written
+ */
+bool saveRecording(const char* path, const Recording& recording);
+
+/**
+ * @brief Reads a recording written by saveRecording
+ *
+ * @return false the file could not be read or is not a valid recording
+ */
+bool loadRecording(const char* path, Recording* recording);
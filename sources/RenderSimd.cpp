@@ -0,0 +1,60 @@
+#include <immintrin.h>
+#include <math.h>
+#include "RenderSimd.h"
+
+// pi / 2 split into a float and the rest, so that j * pi / 2 is subtracted
+// without rounding for the small quadrants j of the angles
+const float HALF_PI_HIGH = 1.57079637050628662109375f;
+const float HALF_PI_LOW = -4.37113900018624283e-8f;
+
+// Minimax polynomials of sin and cos over [-pi / 4, pi / 4], from Cephes
+const float SIN_COEFFICIENTS[] = {-1.6666654611e-1f, 8.3321608736e-3f, -1.9515295891e-4f};
+const float COS_COEFFICIENTS[] = {4.166664568298827e-2f, -1.388731625493765e-3f, 2.443315711809948e-5f};
+
+__attribute__((target("avx2"))) void computeRotations(const float* angles, unsigned count, float* cosines, float* sines) {
+   const __m256 signMask = _mm256_set1_ps(-0.0f);
+   unsigned i = 0;
+   for (; i + ROTATION_SIMD_WIDTH <= count; i += ROTATION_SIMD_WIDTH) {
+      // Quadrant j of the angle, and what is left of it in [-pi / 4, pi / 4]
+      __m256 x = _mm256_loadu_ps(angles + i);
+      __m256 j = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps((float) (2 / M_PI))),
+                                 _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+      x = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(HALF_PI_HIGH)));
+      x = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(HALF_PI_LOW)));
+      __m256 x2 = _mm256_mul_ps(x, x);
+
+      __m256 s = _mm256_set1_ps(SIN_COEFFICIENTS[2]);
+      s = _mm256_add_ps(_mm256_mul_ps(s, x2), _mm256_set1_ps(SIN_COEFFICIENTS[1]));
+      s = _mm256_add_ps(_mm256_mul_ps(s, x2), _mm256_set1_ps(SIN_COEFFICIENTS[0]));
+      s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, x2), x), x);
+
+      __m256 c = _mm256_set1_ps(COS_COEFFICIENTS[2]);
+      c = _mm256_add_ps(_mm256_mul_ps(c, x2), _mm256_set1_ps(COS_COEFFICIENTS[1]));
+      c = _mm256_add_ps(_mm256_mul_ps(c, x2), _mm256_set1_ps(COS_COEFFICIENTS[0]));
+      c = _mm256_mul_ps(_mm256_mul_ps(c, x2), x2);
+      c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(x2, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1));
+
+      // Odd quadrants swap sin and cos. The sine is negated in quadrants 2
+      // and 3, the cosine in quadrants 1 and 2.
+      __m256i quadrant = _mm256_cvtps_epi32(j);
+      __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)),
+                                                           _mm256_set1_epi32(1)));
+      __m256 sine = _mm256_blendv_ps(s, c, swap);
+      __m256 cosine = _mm256_blendv_ps(c, s, swap);
+      __m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(quadrant, 30));
+      __m256 cosineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), 30));
+      sine = _mm256_xor_ps(sine, _mm256_and_ps(sineSign, signMask));
+      cosine = _mm256_xor_ps(cosine, _mm256_and_ps(cosineSign, signMask));
+
+      _mm256_storeu_ps(sines + i, sine);
+      _mm256_storeu_ps(cosines + i, cosine);
+   }
+   // Clears the upper halves of the registers before the calls to libm,
+   // which the compiler only does when optimizing
+   _mm256_zeroupper();
+
+   for (; i < count; i++) {
+      cosines[i] = cosf(angles[i]);
+      sines[i] = sinf(angles[i]);
+   }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// Vectorized stages of the renderer, built for AVX2 and only used when the
+// processor supports it, see hasSimdSupport
+
+// Number of angles turned into rotations at once by computeRotations
+const int ROTATION_SIMD_WIDTH = 8;
+
+/**
+ * @brief Cosines and sines of <count> angles in [-pi, pi], ROTATION_SIMD_WIDTH
+ * at a time with a polynomial approximation, within a few float ulps of the
+ * standard functions
+ */
+void computeRotations(const float* angles, unsigned count, float* cosines, float* sines);
@@ -0,0 +1,737 @@
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "Simulation.h"
+#include "Trace.h"
+
+/**
+ * @brief Seconds elapsed since <start>
+ */
+double secondsSince(Clock::time_point start);
+
+/**
+ * @brief Step used by a simulation with <settings>
+ *
+ * @return NULL the space is stepped by cpSpaceStep
+ */
+ThreadedStep* newThreadedStep(const SimulationSettings& settings);
+
+// Maximum number of steps taken to catch up with real time. Past that the
+// simulation slows down instead of spiraling into ever longer frames.
+const int MAX_CATCHUP_STEPS = 5;
+
+// Auto broadphase : number of balls from which the indices are compared,
+// and number of steps each one is measured over
+const unsigned AUTO_BROADPHASE_MIN_BALLS = 100;
+const int AUTO_BROADPHASE_TRIAL_STEPS = 5;
+
+// Sleep mode : seconds a body must stay idle before falling asleep, and
+// speed under which it is idle, in pixels per second
+const cpFloat SLEEP_TIME_THRESHOLD = 0.5;
+const cpFloat IDLE_SPEED_THRESHOLD = 20;
+
+// Margin added around the viewport when gathering the visible balls, in
+// pixels. It covers how far the balls and the camera move between the
+// publish of a state and its render.
+const cpFloat VIEWPORT_MARGIN = 64;
+
+// Distance between the walls and the sides of the world, in pixels
+const cpFloat WALL_INSET = 10;
+
+// Filter of the queries, only matches the balls
+const cpShapeFilter BALLS_QUERY_FILTER = {CP_NO_GROUP, CP_ALL_CATEGORIES, BALL_CATEGORY};
+
+// Data passed through cpSpaceBBQuery
+typedef struct rect_query_t {
+   const BallStore* balls;
+   std::vector<Handle>* result;
+} RectQuery;
+
+/**
+ * @brief cpSpaceBBQuery callback appending the ball of <shape> to the result
+ */
+void rectQueryCallback(cpShape* shape, void* data);
+
+/**
+ * @brief cpSpaceBBQuery callback appending the index of the ball of <shape>,
+ * kept in the user data of its body, to the vector <data>
+ */
+void visibleQueryCallback(cpShape* shape, void* data);
+
+/**
+ * @brief cpSpaceBBQuery callback setting the bool <data>, to tell if an
+ * area holds a ball
+ */
+void occupiedQueryCallback(cpShape* shape, void* data);
+
+void rectQueryCallback(cpShape* shape, void* data) {
+   RectQuery* query = (RectQuery*) data;
+   query->result->push_back(query->balls->getHandle(shape));
+}
+
+void visibleQueryCallback(cpShape* shape, void* data) {
+   std::vector<unsigned>* visible = (std::vector<unsigned>*) data;
+   visible->push_back((uintptr_t) cpBodyGetUserData(cpShapeGetBody(shape)));
+}
+
+void occupiedQueryCallback(cpShape* shape, void* data) {
+   *(bool*) data = true;
+}
+
+double secondsSince(Clock::time_point start) {
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+ThreadedStep* newThreadedStep(const SimulationSettings& settings) {
+   // The impulses are only vectorized by the colors solver, the arbiters of
+   // an island mostly share bodies with the next ones
+   bool simd = settings.simd && hasSimdSupport();
+   if (settings.threads > 1 || simd)
+      return new ThreadedStep(settings.threads, simd ? SOLVER_COLORS : settings.solver, simd);
+   return NULL;
+}
+
+const char* SIMULATION_USAGE =
+   "[--broadphase auto|bbtree|hash|sweep1d|grid] [--threads N] [--solver colors|islands] [--simd on|off]\n"
+   "          [--sleep on|off] [--seed S] [--spawn random|grid] [--snapshot FILE] [--profile on|off]";
+
+bool parseSimulationOption(int argc, const char* const* argv, int* i, SimulationSettings* settings) {
+   if (*i + 1 >= argc)
+      return false;
+
+   const char* option = argv[*i];
+   const char* value = argv[*i + 1];
+   bool valid = false;
+   if (strcmp(option, "--broadphase") == 0)
+      valid = parseBroadphase(value, &settings->broadphase);
+   else if (strcmp(option, "--threads") == 0 && atoi(value) > 0) {
+      settings->threads = atoi(value);
+      valid = true;
+   } else if (strcmp(option, "--solver") == 0)
+      valid = parseSolverMode(value, &settings->solver);
+   else if (strcmp(option, "--simd") == 0) {
+      valid = strcmp(value, "on") == 0 || strcmp(value, "off") == 0;
+      settings->simd = strcmp(value, "on") == 0;
+   } else if (strcmp(option, "--seed") == 0) {
+      settings->seed = strtoul(value, NULL, 10);
+      valid = true;
+   } else if (strcmp(option, "--spawn") == 0)
+      valid = parseSpawnPattern(value, &settings->spawn);
+   else if (strcmp(option, "--sleep") == 0) {
+      valid = strcmp(value, "on") == 0 || strcmp(value, "off") == 0;
+      settings->sleep = strcmp(value, "on") == 0;
+   } else if (strcmp(option, "--profile") == 0) {
+      valid = strcmp(value, "on") == 0 || strcmp(value, "off") == 0;
+      settings->profile = strcmp(value, "on") == 0;
+   } else if (strcmp(option, "--snapshot") == 0) {
+      settings->snapshotPath = value;
+      valid = true;
+   }
+
+   if (valid)
+      ++ *i;
+   return valid;
+}
+
+Simulation::Simulation(int width, int height, const SimulationSettings& settings):
+   _width(width), _height(height), _timeStep(1.0/60.0),
+   _mouseConstraint(NULL), _linkedBall(NULL_HANDLE), _followedBall(NULL_HANDLE), _stepCount(0),
+   _timings(), _sleep(settings.sleep), _snapshotPath(settings.snapshotPath), _broadphase(settings.broadphase),
+   _activeBroadphase(settings.broadphase == BROADPHASE_AUTO ? BROADPHASE_BBTREE : settings.broadphase),
+   _tunedBallCount(0), _trialBroadphase(BROADPHASE_AUTO), _trialSteps(0),
+   _random(settings.seed), _spawnPattern(settings.spawn), _recordsCommands(false), _replayedCommands(0),
+   _threadedStep(newThreadedStep(settings)), _profiling(settings.profile), _profiledStep(NULL),
+   _running(false), _viewport(cpBBNew(0, 0, width, height)) {
+   _recording.seed = settings.seed;
+   _recording.width = width;
+   _recording.height = height;
+   _recording.spawn = settings.spawn;
+
+   // Walls positions
+   _walls[0] = {{0, height-WALL_INSET}, {(cpFloat) width, height-WALL_INSET}};   // floor
+   _walls[1] = {{0, WALL_INSET}, {(cpFloat) width, WALL_INSET}};                  // roof
+   _walls[2] = {{WALL_INSET, 0}, {WALL_INSET, (cpFloat) height}};                 // left wall
+   _walls[3] = {{width-WALL_INSET, 0}, {width-WALL_INSET, (cpFloat) height}};     // right wall
+
+   createSpace();
+
+   _stepTime = Clock::now();
+   publish();
+}
+
+Simulation::~Simulation() {
+   stop();
+
+   release();
+   destroySpace();
+   _balls.clear();
+   delete _threadedStep;
+   delete _profiledStep;
+}
+
+void Simulation::createSpace() {
+   // Creation of the new space
+   _space = cpSpaceNew();
+   cpSpaceSetGravity(_space, cpv(0, 1000));
+   if (_sleep) {
+      cpSpaceSetSleepTimeThreshold(_space, SLEEP_TIME_THRESHOLD);
+      cpSpaceSetIdleSpeedThreshold(_space, IDLE_SPEED_THRESHOLD);
+   }
+
+   // Creation of the walls
+   for (int i = 0; i < NB_WALLS; i++) {
+      _ground[i] = cpSegmentShapeNew(cpSpaceGetStaticBody(_space), _walls[i].a, _walls[i].b, 0);
+      cpShapeSetFriction(_ground[i], 0.5);
+      cpShapeSetElasticity(_ground[i], 0);
+      cpShapeSetFilter(_ground[i], cpShapeFilterNew(CP_NO_GROUP, WALL_CATEGORY, CP_ALL_CATEGORIES));
+      cpSpaceAddShape(_space, _ground[i]);
+   }
+
+   // The space is empty, the choice is made again when balls are added
+   _tunedBallCount = 0;
+   _trialBroadphase = BROADPHASE_AUTO;
+   if (_activeBroadphase != BROADPHASE_BBTREE)
+      applyBroadphase(_activeBroadphase);
+}
+
+void Simulation::destroySpace() {
+   // cpSpaceFree skips some of the sleeping components when waking them up
+   // and would leak the contacts they keep, they are woken up here first
+   for (unsigned i = 0; i < _balls.size(); i++)
+      cpBodyActivate(_balls.getBody(i));
+
+   // Balls bodies and shapes belong to the pool of the store and are not
+   // freed here
+   cpSpaceFree(_space);
+   _space = NULL;
+
+   for (int i = 0; i < NB_WALLS; i++)
+      cpShapeFree(_ground[i]);
+}
+
+void Simulation::start() {
+   if (_running)
+      return;
+   _running = true;
+   _thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop() {
+   _running = false;
+   if (_thread.joinable())
+      _thread.join();
+}
+
+void Simulation::pushCommand(const Command& command) {
+   std::lock_guard<std::mutex> lock(_commandsMutex);
+   _commands.push_back(command);
+}
+
+void Simulation::setViewport(cpBB viewport) {
+   std::lock_guard<std::mutex> lock(_viewportMutex);
+   _viewport = viewport;
+}
+
+const WorldState& Simulation::getState() {
+   _states.update();
+   return _states.getFrontBuffer();
+}
+
+cpFloat Simulation::getAlpha(const WorldState& state) const {
+   std::chrono::duration<cpFloat> elapsed = Clock::now() - state.stepTime;
+   return cpfclamp01(elapsed.count() / _timeStep);
+}
+
+Handle Simulation::queryPoint(cpVect point, cpFloat maxDistance) const {
+   cpShape* shape = cpSpacePointQueryNearest(_space, point, maxDistance, BALLS_QUERY_FILTER, NULL);
+   return shape ? _balls.getHandle(shape) : NULL_HANDLE;
+}
+
+void Simulation::queryRect(cpBB rect, std::vector<Handle>* balls) const {
+   RectQuery query = {&_balls, balls};
+   cpSpaceBBQuery(_space, rect, BALLS_QUERY_FILTER, rectQueryCallback, &query);
+}
+
+void Simulation::advance() {
+   processCommands();
+   step();
+   publish();
+}
+
+void Simulation::run() {
+   const Clock::duration timeStep =
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<cpFloat>(_timeStep));
+   Clock::time_point nextStep = Clock::now();
+   setTraceThreadName("physics");
+
+   while (_running) {
+      processCommands();
+
+      // Consume the elapsed time by fixed steps
+      int steps = 0;
+      while (Clock::now() >= nextStep && steps < MAX_CATCHUP_STEPS) {
+         step();
+         publish();
+         nextStep += timeStep;
+         ++ steps;
+      }
+      // Too far behind : drop the time we could not simulate
+      if (Clock::now() >= nextStep)
+         nextStep = Clock::now() + timeStep;
+
+      std::this_thread::sleep_until(nextStep);
+   }
+}
+
+void Simulation::processCommands() {
+   TraceScope trace("commands");
+   Clock::time_point start = Clock::now();
+   {
+      std::lock_guard<std::mutex> lock(_commandsMutex);
+      _pendingCommands.swap(_commands);
+   }
+
+   for (unsigned i = 0; i < _pendingCommands.size(); i++)
+      executeCommand(_pendingCommands[i]);
+   _pendingCommands.clear();
+   _timings.commands = secondsSince(start);
+}
+
+void Simulation::executeCommand(const Command& command) {
+   if (_recordsCommands)
+      _recording.commands.push_back({_stepCount, command});
+
+   switch (command.type) {
+      case COMMAND_SPAWN:
+         if (!_mouseConstraint)
+            spawnBalls(command.x, command.y, command.count);
+         break;
+      case COMMAND_GRAB:
+         if (!_mouseConstraint)
+            grab(command.x, command.y);
+         break;
+      case COMMAND_DRAG:
+         if (_mouseConstraint)
+            cpPivotJointSetAnchorB(_mouseConstraint, cpv(command.x, command.y));
+         break;
+      case COMMAND_RELEASE:
+         release();
+         break;
+      case COMMAND_RESET:
+         clearSpace();
+         break;
+      case COMMAND_SAVE:
+         saveSnapshot(_snapshotPath.c_str());
+         break;
+      case COMMAND_LOAD:
+         loadSnapshot(_snapshotPath.c_str());
+         break;
+      case COMMAND_FOLLOW:
+         follow(command.x, command.y);
+         break;
+      default:
+         break;
+   }
+}
+
+void Simulation::replayCommands() {
+   Clock::time_point start = Clock::now();
+   const std::vector<RecordedCommand>& commands = _replay.commands;
+   while (_replayedCommands < commands.size() && commands[_replayedCommands].step <= _stepCount)
+      executeCommand(commands[_replayedCommands++].command);
+   _timings.commands += secondsSince(start);
+}
+
+void Simulation::startRecording() {
+   _recording.commands.clear();
+   _recordsCommands = true;
+}
+
+void Simulation::replay(const Recording& recording) {
+   _replay = recording;
+   _replayedCommands = 0;
+}
+
+bool Simulation::saveSnapshot(const char* path) {
+   TraceScope trace("save snapshot");
+   Clock::time_point start = Clock::now();
+   SnapshotHeader header = SnapshotHeader();
+   header.width = _width;
+   header.height = _height;
+   header.stepCount = _stepCount;
+   for (int i = 0; i < NB_WALLS; i++)
+      header.walls[i] = _walls[i];
+   header.linkedBall = _balls.getIndex(_linkedBall);
+   if (_mouseConstraint) {
+      header.linkAnchorA = cpPivotJointGetAnchorA(_mouseConstraint);
+      header.linkAnchorB = cpPivotJointGetAnchorB(_mouseConstraint);
+   }
+
+   const BallArrays& arrays = _balls.getArrays();
+   std::vector<SnapshotBall> balls(_balls.size());
+   for (unsigned i = 0; i < balls.size(); i++) {
+      cpBody* body = _balls.getBody(i);
+      cpShape* shape = _balls.getShape(i);
+      SnapshotBall& ball = balls[i];
+      ball.position = cpBodyGetPosition(body);
+      ball.velocity = cpBodyGetVelocity(body);
+      ball.angle = cpBodyGetAngle(body);
+      ball.angularVelocity = cpBodyGetAngularVelocity(body);
+      ball.velocityBias = body->v_bias;
+      ball.angularVelocityBias = body->w_bias;
+      ball.friction = cpShapeGetFriction(shape);
+      ball.elasticity = cpShapeGetElasticity(shape);
+      ball.mass = _balls.getMass(i);
+      ball.radius = arrays.radii[i];
+      ball.color = arrays.colors[i];
+      ball.padding = 0;
+   }
+
+   std::vector<SnapshotArbiter> arbiters;
+   std::vector<SnapshotContact> contacts;
+   captureArbiters(_space, _balls, _ground, &arbiters, &contacts);
+
+   if (!writeSnapshot(path, header, balls, arbiters, contacts))
+      return false;
+   fprintf(stderr, "%u balls and %u contacts saved into %s in %.1f ms\n", _balls.size(),
+           (unsigned) contacts.size(), path, secondsSince(start) * 1000);
+   return true;
+}
+
+bool Simulation::loadSnapshot(const char* path) {
+   TraceScope trace("load snapshot");
+   Clock::time_point start = Clock::now();
+   SnapshotFile file;
+   if (!file.open(path))
+      return false;
+   const SnapshotHeader& header = file.getHeader();
+   if (header.width != _width || header.height != _height) {
+      fprintf(stderr, "%s is a snapshot of a %dx%d world\n", path, header.width, header.height);
+      return false;
+   }
+
+   release();
+   destroySpace();
+   _balls.clear();
+   for (int i = 0; i < NB_WALLS; i++)
+      _walls[i] = header.walls[i];
+   createSpace();
+
+   // The balls are added in the order of the file, the index of a ball in
+   // the store is the one it is referred to by
+   const SnapshotBall* balls = file.getBalls();
+   std::vector<BallSpawn> spawns(header.ballCount);
+   for (unsigned i = 0; i < header.ballCount; i++) {
+      spawns[i].position = balls[i].position;
+      spawns[i].mass = balls[i].mass;
+      spawns[i].radius = balls[i].radius;
+      spawns[i].color = balls[i].color;
+   }
+   _balls.reserve(header.ballCount);
+   _balls.addMany(_space, spawns);
+   for (unsigned i = 0; i < header.ballCount; i++) {
+      const SnapshotBall& ball = balls[i];
+      cpBody* body = _balls.getBody(i);
+      cpShape* shape = _balls.getShape(i);
+      cpBodySetVelocity(body, ball.velocity);
+      cpBodySetAngle(body, ball.angle);
+      cpBodySetAngularVelocity(body, ball.angularVelocity);
+      body->v_bias = ball.velocityBias;
+      body->w_bias = ball.angularVelocityBias;
+      cpShapeSetFriction(shape, ball.friction);
+      cpShapeSetElasticity(shape, ball.elasticity);
+   }
+   restoreArbiters(_space, _balls, _ground, file.getArbiters(), header.arbiterCount,
+                   file.getContacts(), header.contactCount);
+
+   if (header.linkedBall >= 0 && (unsigned) header.linkedBall < _balls.size()) {
+      _linkedBall = _balls.getHandle(header.linkedBall);
+      _mouseConstraint = cpPivotJointNew2(_balls.getBody(header.linkedBall), cpSpaceGetStaticBody(_space),
+                                          header.linkAnchorA, header.linkAnchorB);
+      cpSpaceAddConstraint(_space, _mouseConstraint);
+   }
+
+   // Poses of the restored bodies, without interpolation from the ones of
+   // the previous world
+   _balls.readBack(_space);
+   _balls.savePreviousState();
+   _stepCount = header.stepCount;
+   fprintf(stderr, "%u balls and %u contacts restored from %s in %.1f ms\n", _balls.size(),
+           (unsigned) header.contactCount, path, secondsSince(start) * 1000);
+   return true;
+}
+
+void Simulation::step() {
+   TraceScope trace("step");
+
+   // Replayed commands are executed right before their step, as if they
+   // had been queued in time
+   if (isReplaying())
+      replayCommands();
+
+   _balls.savePreviousState();
+   tuneBroadphase();
+
+   Clock::time_point start = Clock::now();
+   ThreadedStep* stepper = getStepper();
+   if (stepper)
+      stepper->step(_space, _timeStep);
+   else {
+      TraceScope traceStep("cpSpaceStep");
+      cpSpaceStep(_space, _timeStep);
+   }
+   _stepTime = Clock::now();
+   ++ _stepCount;
+   _timings.step = secondsSince(start);
+   for (int i = 0; i < NB_STEP_PHASES; i++)
+      _timings.phases[i] = stepper ? stepper->getPhaseTimes()[i] : 0;
+   _timings.substituteStep = stepper && stepper != _threadedStep;
+
+   // Measure of the broadphase on trial, the step also includes the solver
+   // which does not depend on it
+   if (_trialBroadphase != BROADPHASE_AUTO) {
+      _trialTimes[_trialBroadphase] += _timings.step;
+      ++ _trialSteps;
+   }
+
+   start = Clock::now();
+   TraceScope traceReadBack("readback");
+   _balls.readBack(_space);
+
+   // Remove the balls that escaped the screen, in one pass once the whole
+   // list has been checked
+   const std::vector<cpVect>& positions = _balls.getArrays().positions;
+   for (unsigned i = 0; i < positions.size(); i++) {
+      if (positions[i].x > _width || positions[i].x < 0
+          || positions[i].y > _height || positions[i].y < 0)
+         _removedBalls.push_back(_balls.getHandle(i));
+   }
+   for (unsigned i = 0; i < _removedBalls.size(); i++)
+      removeBall(_removedBalls[i]);
+   _removedBalls.clear();
+   _timings.readBack = secondsSince(start);
+}
+
+ThreadedStep* Simulation::getStepper() {
+   if (_threadedStep || !_profiling.load(std::memory_order_relaxed))
+      return _threadedStep;
+   if (!_profiledStep)
+      _profiledStep = new ThreadedStep(1, SOLVER_ISLANDS, false);
+   return _profiledStep;
+}
+
+void Simulation::tuneBroadphase() {
+   // Current trial over : next candidate, or choice of the fastest one
+   if (_trialBroadphase != BROADPHASE_AUTO && _trialSteps >= AUTO_BROADPHASE_TRIAL_STEPS) {
+      int next = _trialBroadphase + 1;
+      if (next < NB_BROADPHASES) {
+         _trialBroadphase = (Broadphase) next;
+         _trialSteps = 0;
+         applyBroadphase(_trialBroadphase);
+         return;
+      }
+
+      Broadphase fastest = BROADPHASE_BBTREE;
+      for (int i = BROADPHASE_BBTREE; i < NB_BROADPHASES; i++) {
+         if (_trialTimes[i] < _trialTimes[fastest])
+            fastest = (Broadphase) i;
+      }
+      _trialBroadphase = BROADPHASE_AUTO;
+      applyBroadphase(fastest);
+      fprintf(stderr, "Broadphase set to %s for %u balls\n", getBroadphaseName(fastest), _balls.size());
+      return;
+   }
+   if (_trialBroadphase != BROADPHASE_AUTO)
+      return;
+
+   // Nothing to do until the number of balls changes by an order of magnitude
+   unsigned count = _balls.size();
+   if (_tunedBallCount != 0 && count < _tunedBallCount * 10 && count * 10 > _tunedBallCount)
+      return;
+   if (_broadphase == BROADPHASE_AUTO && count < AUTO_BROADPHASE_MIN_BALLS)
+      return;
+   if (count == 0)
+      return;
+   _tunedBallCount = count;
+
+   if (_broadphase == BROADPHASE_AUTO) {
+      for (int i = 0; i < NB_BROADPHASES; i++)
+         _trialTimes[i] = 0;
+      _trialBroadphase = BROADPHASE_BBTREE;
+      _trialSteps = 0;
+      applyBroadphase(_trialBroadphase);
+   } else if (_broadphase == BROADPHASE_HASH || _broadphase == BROADPHASE_GRID)
+      applyBroadphase(_broadphase);
+}
+
+void Simulation::applyBroadphase(Broadphase broadphase) {
+   TraceScope trace("switch broadphase");
+   // Cells of the hash about the size of a ball, ten times more cells than
+   // balls as advised by chipmunk. Cells of the grid as large as the
+   // largest ball, over the area of the walls.
+   const std::vector<int>& radii = _balls.getArrays().radii;
+   cpFloat radius = 30, maxRadius = 30;
+   if (!radii.empty()) {
+      radius = 0;
+      maxRadius = 0;
+      for (unsigned i = 0; i < radii.size(); i++) {
+         radius += radii[i];
+         maxRadius = cpfmax(maxRadius, radii[i]);
+      }
+      radius /= radii.size();
+   }
+   int cellCount = cpfmax(1000, radii.size() * 10);
+   cpFloat cellSize = 2 * (broadphase == BROADPHASE_GRID ? maxRadius : radius);
+
+   useBroadphase(_space, broadphase, cellSize, cellCount, cpBBNew(0, 0, _width, _height));
+   _activeBroadphase = broadphase;
+}
+
+void Simulation::publish() {
+   TraceScope trace("publish");
+   Clock::time_point start = Clock::now();
+   WorldState& state = _states.getBackBuffer();
+
+   // Vector assignments reuse the memory of the buffer
+   state.balls = _balls.getArrays();
+   gatherVisible(&state);
+   state.linkedBallId = _balls.getIndex(_linkedBall);
+   state.followedBallId = _balls.getIndex(_followedBall);
+   state.stepTime = _stepTime;
+   state.stepCount = _stepCount;
+   state.broadphase = _activeBroadphase;
+   state.awakeBalls = _balls.getAwakeCount();
+   state.timings = _timings;
+
+   _states.publish();
+   _timings.publish = secondsSince(start);
+}
+
+void Simulation::gatherVisible(WorldState* state) {
+   {
+      std::lock_guard<std::mutex> lock(_viewportMutex);
+      state->viewport = _viewport;
+   }
+   state->visible.clear();
+
+   // Balls leaving the world are removed, a view of the whole world sees
+   // them all without a query
+   const cpBB& view = state->viewport;
+   cpBB area = cpBBNew(view.l - VIEWPORT_MARGIN, view.b - VIEWPORT_MARGIN,
+                       view.r + VIEWPORT_MARGIN, view.t + VIEWPORT_MARGIN);
+   if (cpBBContainsBB(area, cpBBNew(0, 0, _width, _height))) {
+      state->visible.resize(state->balls.size());
+      for (unsigned i = 0; i < state->visible.size(); i++)
+         state->visible[i] = i;
+      return;
+   }
+   cpSpaceBBQuery(_space, area, BALLS_QUERY_FILTER, visibleQueryCallback, &state->visible);
+}
+
+void Simulation::spawnBalls(int x, int y, int count) {
+   if (count <= 0 || count > MAX_SPAWN_COUNT) {
+      fprintf(stderr, "Spawn of %d balls ignored\n", count);
+      return;
+   }
+   TraceScope trace("spawn");
+   const int radius = 30, mass = 5;
+   std::vector<cpVect> placed;
+   if (_spawnPattern == SPAWN_GRID && count > 1)
+      placeOnGrid(count, radius, &placed);
+
+   std::vector<BallSpawn> spawns(count);
+   for (int i = 0; i < count; i++) {
+      BallSpawn& spawn = spawns[i];
+      spawn.mass = mass;
+      spawn.radius = radius;
+      spawn.color.r = (uint8_t) (_random() % 0xFF);
+      spawn.color.g = (uint8_t) (_random() % 0xFF);
+      spawn.color.b = (uint8_t) (_random() % 0xFF);
+      spawn.color.a = 0xFF;
+      if (count == 1)
+         spawn.position = cpv(x, y);
+      else if (i < (int) placed.size())
+         spawn.position = placed[i];
+      else {
+         // Balls the grid has no room for are put anywhere. One draw after
+         // the other, the order of evaluation of arguments is unspecified
+         // and replays must give the same positions.
+         cpFloat positionX = _random() % _width;
+         cpFloat positionY = _random() % _height;
+         spawn.position = cpv(positionX, positionY);
+      }
+   }
+
+   _balls.addMany(_space, spawns);
+   fprintf(stderr, "%d %s added at (%d, %d)\n", count, (count==1)?"ball":"balls", x, y);
+}
+
+void Simulation::placeOnGrid(int count, int radius, std::vector<cpVect>* positions) {
+   // Cells hold a ball and a gap, the ball is moved by up to half the gap
+   // so that the balls do not line up
+   int gap = std::max(radius / 2, 2);
+   int cellSize = 2 * radius + gap;
+   int left = (int) WALL_INSET, bottom = (int) WALL_INSET;
+   int columns = std::max((int) (_width - 2 * WALL_INSET) / cellSize, 0);
+   int rows = std::max((int) (_height - 2 * WALL_INSET) / cellSize, 0);
+
+   // Cells drawn by a partial Fisher-Yates shuffle, those holding a ball
+   // already are skipped
+   std::vector<int> cells(columns * rows);
+   for (unsigned i = 0; i < cells.size(); i++)
+      cells[i] = i;
+   positions->clear();
+   for (unsigned i = 0; i < cells.size() && (int) positions->size() < count; i++) {
+      std::swap(cells[i], cells[i + _random() % (cells.size() - i)]);
+      int column = cells[i] % columns, row = cells[i] / columns;
+      cpBB cell = cpBBNew(left + column * cellSize, bottom + row * cellSize,
+                          left + (column + 1) * cellSize, bottom + (row + 1) * cellSize);
+      bool occupied = false;
+      cpSpaceBBQuery(_space, cell, BALLS_QUERY_FILTER, occupiedQueryCallback, &occupied);
+      if (occupied)
+         continue;
+
+      int jitterX = (int) (_random() % (gap + 1)) - gap / 2;
+      int jitterY = (int) (_random() % (gap + 1)) - gap / 2;
+      positions->push_back(cpv(cell.l + cellSize / 2.0 + jitterX, cell.b + cellSize / 2.0 + jitterY));
+   }
+}
+
+void Simulation::removeBall(Handle ball) {
+   if (ball == _linkedBall)
+      release();
+   _balls.remove(_space, ball);
+}
+
+void Simulation::clearSpace() {
+   TraceScope trace("clear space");
+   release();
+   destroySpace();
+   _balls.clear();
+   createSpace();
+}
+
+void Simulation::grab(int x, int y) {
+   Handle ball = queryPoint(cpv(x, y));
+   if (ball == NULL_HANDLE)
+      return;
+
+   _linkedBall = ball;
+   _mouseConstraint = cpPivotJointNew(_balls.getBody(_balls.getIndex(ball)), cpSpaceGetStaticBody(_space), cpv(x, y));
+   cpSpaceAddConstraint(_space, _mouseConstraint);
+}
+
+void Simulation::follow(int x, int y) {
+   // The handle becomes invalid once the ball is removed, nothing else
+   // needs to forget it
+   _followedBall = queryPoint(cpv(x, y));
+}
+
+void Simulation::release() {
+   if (_mouseConstraint) {
+      cpSpaceRemoveConstraint(_space, _mouseConstraint);
+      cpConstraintFree(_mouseConstraint);
+      _mouseConstraint = NULL;
+      _linkedBall = NULL_HANDLE;
+   }
+}
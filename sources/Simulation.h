@@ -0,0 +1,345 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include "chipmunk/chipmunk.h"
+#include "Ball.h"
+#include "BallStore.h"
+#include "TripleBuffer.h"
+#include "Broadphase.h"
+#include "ThreadedStep.h"
+#include "Recording.h"
+#include "Snapshot.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+// Duration of the phases of the last step, in seconds
+typedef struct step_timings_t {
+   double commands;  // queued commands, spawns included
+   double step;      // cpSpaceStep
+   double readBack;  // poses read back from the bodies and out-of-bounds cull
+   double publish;   // copy of the state into the triple buffer
+   // Phases of cpSpaceStep, all 0 when the step is not taken by ThreadedStep
+   double phases[NB_STEP_PHASES];
+   // The step was taken by a single-threaded islands ThreadedStep standing
+   // in for cpSpaceStep, so that its phases could be timed
+   bool substituteStep;
+} StepTimings;
+
+// How the world is simulated, set on the command line
+typedef struct simulation_settings_t {
+   // Index of the dynamic shapes. In auto mode, each index is tried over a
+   // few steps whenever the number of balls changes by an order of
+   // magnitude, and the fastest one is kept.
+   Broadphase broadphase = BROADPHASE_AUTO;
+   // Number of threads stepping the space. With more than one, ThreadedStep
+   // replaces cpSpaceStep, with the given solver mode. Islands give the
+   // results of cpSpaceStep, and the colors solver has not been measured
+   // faster than them.
+   unsigned threads = 1;
+   SolverMode solver = SOLVER_ISLANDS;
+   // Vectorized paths for the circles, when the processor supports them :
+   // the overlap tests of the narrowphase, and the impulses of the single
+   // contact arbiters, which imply the colors solver. ThreadedStep is then
+   // used even with a single thread, and the contacts are no longer solved
+   // in the order of cpSpaceStep. Off by default, they are not faster.
+   bool simd = false;
+   // Bodies resting long enough fall asleep, and cost nothing until
+   // something touches them
+   bool sleep = false;
+   // Times the phases of each step from the first one, see setProfiling
+   bool profile = false;
+   // Seed of the random positions and colors of the spawned balls
+   uint32_t seed = 1;
+   // Placement of the balls of a spawn. On a grid, they start apart and the
+   // first steps do not push overlapping balls out of each other.
+   SpawnPattern spawn = SPAWN_GRID;
+   // File written and read by the save and load commands
+   const char* snapshotPath = "snapshot.bin";
+} SimulationSettings;
+
+// Usage of the options read by parseSimulationOption
+extern const char* SIMULATION_USAGE;
+
+/**
+ * @brief Reads the simulation option at argv[*i], and its value
+ *
+ * @param i index of the option, moved to its last argument
+ * @return false argv[*i] is not a valid simulation option
+ */
+bool parseSimulationOption(int argc, const char* const* argv, int* i, SimulationSettings* settings);
+
+// Everything the renderer needs to know about the world after a step
+typedef struct world_state_t {
+   BallArrays balls;
+   // Indices in <balls> of the balls overlapping <viewport>, in no
+   // particular order. Only those need to be drawn.
+   std::vector<unsigned> visible;
+   cpBB viewport;
+   // Index in <balls> of the ball linked to the mouse, -1 if there is none
+   int linkedBallId;
+   // Index in <balls> of the ball followed by the camera, -1 if there is none
+   int followedBallId;
+   // When the step that produced this state was taken
+   Clock::time_point stepTime;
+   unsigned long stepCount;
+   // Index the dynamic shapes are stored in
+   Broadphase broadphase;
+   // Number of balls whose body is awake, the others sleep
+   unsigned awakeBalls;
+   // Timings of the step, the publish ones being those of the previous step
+   StepTimings timings;
+} WorldState;
+
+/**
+ * @brief Owns the cpSpace and steps it at a fixed rate on its own thread.
+ * The space is never touched from another thread : inputs are queued as
+ * commands and the resulting world is published into a triple buffer
+ * after every step.
+ */
+class Simulation {
+   public:
+      static const int NB_WALLS = 4;
+
+      /**
+       * @brief Creates the space and the walls around a <width> x <height>
+       * area of the world. Balls leaving it are removed.
+       */
+      Simulation(int width, int height, const SimulationSettings& settings = SimulationSettings());
+      ~Simulation();
+
+      // Starts and stops the physics thread
+      void start();
+      void stop();
+
+      // Queues a command, executed by the physics thread before its next step
+      void pushCommand(const Command& command);
+
+      /**
+       * @brief Sets the area of the world seen by the renderer, the whole
+       * world by default. The balls overlapping it are gathered through the
+       * spatial index of the space into the visible list of each published
+       * state. Can be called from any thread.
+       */
+      void setViewport(cpBB viewport);
+
+      /**
+       * @brief Times the phases of the steps from the next one on, or stops
+       * timing them. cpSpaceStep can not be timed from the outside, when it
+       * steps the space a ThreadedStep on a single thread takes over, by
+       * islands to give the same results. Can be called from any thread.
+       */
+      void setProfiling(bool profiling) { _profiling = profiling; }
+
+      /**
+       * @brief Gives the most recent state published by the physics thread.
+       * Must only be called from the render thread, the returned reference
+       * stays valid until the next call.
+       */
+      const WorldState& getState();
+
+      /**
+       * @brief Blending factor between the previous and the current poses of
+       * <state> at the current time
+       */
+      cpFloat getAlpha(const WorldState& state) const;
+
+      /**
+       * @brief Executes the queued commands, steps once and publishes the
+       * result from the calling thread. Only for use without the physics
+       * thread, headless tools drive the simulation with it.
+       */
+      void advance();
+
+      /**
+       * @brief Records the commands executed from now on, with the number
+       * of steps taken before each of them
+       */
+      void startRecording();
+
+      /**
+       * @brief Commands recorded since startRecording, along with the size
+       * and the seed of the simulation. Only to be read once the physics
+       * thread is stopped.
+       */
+      const Recording& getRecording() const { return _recording; }
+
+      /**
+       * @brief Executes the commands of <recording> right before the steps
+       * they were recorded at. Must be called before the first step, the
+       * simulation should have the size, the seed and the spawn pattern of
+       * the recording for the run to be the same.
+       */
+      void replay(const Recording& recording);
+
+      /**
+       * @brief Writes the balls, the walls, the mouse link and the cached
+       * contacts of the world into a snapshot file. Only to be called from
+       * the thread stepping the simulation.
+       *
+       * @return false the file could not be written
+       */
+      bool saveSnapshot(const char* path);
+
+      /**
+       * @brief Replaces the world by the one of a snapshot file, which must
+       * have the size of the simulation. The file is mapped and its balls
+       * added in bulk by BallStore::addMany, every body is awake once
+       * restored. Only to be called from the thread stepping the
+       * simulation.
+       *
+       * @return false the file could not be read, the world is left as it is
+       */
+      bool loadSnapshot(const char* path);
+
+      // Whether commands of the replay have not been executed yet
+      bool isReplaying() const { return _replayedCommands < _replay.commands.size(); }
+      unsigned long getStepCount() const { return _stepCount; }
+
+      /**
+       * @brief Ball under <point>, found through the spatial index of the
+       * space. Only to be called from the thread stepping the simulation.
+       *
+       * @param maxDistance how far from the point the ball can be
+       * @return handle of the nearest ball, NULL_HANDLE if there is none
+       */
+      Handle queryPoint(cpVect point, cpFloat maxDistance = 0) const;
+
+      /**
+       * @brief Appends to <balls> the balls whose bounding box overlaps
+       * <rect>. Only to be called from the thread stepping the simulation.
+       */
+      void queryRect(cpBB rect, std::vector<Handle>* balls) const;
+
+      const Segment* getWalls() const { return _walls; }
+      cpFloat getTimeStep() const { return _timeStep; }
+
+      // Number of balls and timings of the last step, only to be read from
+      // the thread stepping the simulation
+      unsigned getBallCount() const { return _balls.size(); }
+      unsigned getAwakeCount() const { return _balls.getAwakeCount(); }
+      const StepTimings& getTimings() const { return _timings; }
+      Broadphase getBroadphase() const { return _activeBroadphase; }
+      unsigned getThreadCount() const { return _threadedStep ? _threadedStep->getThreadCount() : 1; }
+      bool usesSimd() const { return _threadedStep && _threadedStep->usesSimd(); }
+      // cpSpaceStep solves the arbiters in the order of the islands solver
+      SolverMode getSolverMode() const { return _threadedStep ? _threadedStep->getMode() : SOLVER_ISLANDS; }
+
+   private:
+      // Creates the space and its walls
+      void createSpace();
+      // Frees the space and the walls, the balls must have been cleared
+      void destroySpace();
+
+      void run();
+      void processCommands();
+      // Executes <command>, and records it if recording
+      void executeCommand(const Command& command);
+      // Executes the replayed commands recorded at the current step
+      void replayCommands();
+      void step();
+      // Step taking the next step, NULL when it is cpSpaceStep
+      ThreadedStep* getStepper();
+      // Resizes or chooses the broadphase again for the current balls
+      void tuneBroadphase();
+      // Switches the space to <broadphase>, the hash is sized for the balls
+      void applyBroadphase(Broadphase broadphase);
+      void publish();
+      // Fills the visible list of <state>, its balls must be published
+      void gatherVisible(WorldState* state);
+
+      /**
+       * @brief Adds <count> random balls to the space, the only ball is put
+       * at (x, y) when <count> is 1
+       */
+      void spawnBalls(int x, int y, int count);
+
+      /**
+       * @brief Draws positions in free cells of a grid covering the world
+       * for <count> balls of <radius>, jittered within their cells
+       *
+       * @param positions receives one position per free cell drawn, fewer
+       * than <count> when the grid is full
+       */
+      void placeOnGrid(int count, int radius, std::vector<cpVect>* positions);
+
+      /**
+       * @brief Removes a ball from the space and frees it, releasing the
+       * mouse link first if the ball is linked
+       */
+      void removeBall(Handle ball);
+
+      /**
+       * @brief Removes every ball. Rather than removing them one by one, the
+       * whole space is dropped and created again.
+       */
+      void clearSpace();
+
+      // Links the ball under (x, y) to the mouse with a pivot joint
+      void grab(int x, int y);
+      void release();
+
+      // Follows the ball under (x, y), or stops following if there is none
+      void follow(int x, int y);
+
+      const int _width, _height;
+      const cpFloat _timeStep;
+
+      cpSpace* _space;
+      Segment _walls[NB_WALLS];
+      cpShape* _ground[NB_WALLS];
+      BallStore _balls;
+      // Balls to remove once the step is over
+      std::vector<Handle> _removedBalls;
+      cpConstraint* _mouseConstraint;
+      Handle _linkedBall;
+      Handle _followedBall;
+      unsigned long _stepCount;
+      Clock::time_point _stepTime;
+      StepTimings _timings;
+
+      const bool _sleep;
+      const std::string _snapshotPath;
+      const Broadphase _broadphase;
+      Broadphase _activeBroadphase;
+      // Number of balls the broadphase has been chosen for, 0 if none
+      unsigned _tunedBallCount;
+      // Broadphase being measured in auto mode, BROADPHASE_AUTO if none
+      Broadphase _trialBroadphase;
+      int _trialSteps;
+      double _trialTimes[NB_BROADPHASES];
+
+      // Spawned balls are placed and colored from it
+      std::mt19937 _random;
+      const SpawnPattern _spawnPattern;
+
+      bool _recordsCommands;
+      Recording _recording;
+      Recording _replay;
+      unsigned _replayedCommands;
+
+      // Multi-threaded step, NULL when the space is stepped by cpSpaceStep
+      ThreadedStep* _threadedStep;
+      // Takes the place of cpSpaceStep while profiling, created on the
+      // first profiled step
+      std::atomic<bool> _profiling;
+      ThreadedStep* _profiledStep;
+
+      std::thread _thread;
+      std::atomic<bool> _running;
+
+      std::mutex _commandsMutex;
+      std::vector<Command> _commands;
+      // Only used by the physics thread, swapped with <_commands>
+      std::vector<Command> _pendingCommands;
+
+      TripleBuffer<WorldState> _states;
+
+      std::mutex _viewportMutex;
+      cpBB _viewport;
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// Stable reference to an element of a SlotMap
+typedef struct handle_t {
+   uint32_t index;       // slot of the element
+   uint32_t generation;  // must match the slot generation to be valid
+} Handle;
+
+const Handle NULL_HANDLE = {UINT32_MAX, 0};
+
+inline bool operator==(Handle a, Handle b) { return a.index == b.index && a.generation == b.generation; }
+inline bool operator!=(Handle a, Handle b) { return !(a == b); }
+
+/**
+ * @brief Generational slot map. The owner keeps its elements densely, in
+ * one or several arrays, so that they can be iterated linearly, and
+ * removes them in O(1) by moving the last element into the hole. The slot
+ * map maps stable handles to the dense indices : handles stay valid when
+ * elements move, and become invalid, instead of pointing to another
+ * element, once theirs is removed.
+ */
+class SlotMap {
+   public:
+      SlotMap(): _freeSlot(UINT32_MAX) {}
+
+      // Registers an element appended at the end of the dense arrays
+      Handle insert() {
+         uint32_t slot;
+         if (_freeSlot != UINT32_MAX) {
+            slot = _freeSlot;
+            _freeSlot = _slots[slot].index;
+         } else {
+            slot = _slots.size();
+            _slots.push_back({0, 0});
+         }
+         _slots[slot].index = _denseToSlot.size();
+         _denseToSlot.push_back(slot);
+         return {slot, _slots[slot].generation};
+      }
+
+      /**
+       * @brief Unregisters the element of <handle>. The owner must then move
+       * its element at <last> to <hole> and shrink its arrays by one.
+       *
+       * @param hole dense index of the removed element
+       * @param last dense index of the element moved into the hole
+       * @return false the handle was not valid
+       */
+      bool remove(Handle handle, unsigned* hole, unsigned* last) {
+         if (!contains(handle))
+            return false;
+
+         *hole = _slots[handle.index].index;
+         *last = _denseToSlot.size() - 1;
+         _denseToSlot[*hole] = _denseToSlot[*last];
+         _slots[_denseToSlot[*hole]].index = *hole;
+         _denseToSlot.pop_back();
+
+         // Invalidates the outstanding handles and recycles the slot
+         _slots[handle.index].generation++;
+         _slots[handle.index].index = _freeSlot;
+         _freeSlot = handle.index;
+         return true;
+      }
+
+      bool contains(Handle handle) const {
+         return handle.index < _slots.size() && _slots[handle.index].generation == handle.generation;
+      }
+
+      // Dense index of the element of <handle>, -1 if the handle is not valid
+      int getDenseIndex(Handle handle) const {
+         return contains(handle) ? (int) _slots[handle.index].index : -1;
+      }
+
+      // Handle of the element at <denseIndex>
+      Handle getHandle(unsigned denseIndex) const {
+         uint32_t slot = _denseToSlot[denseIndex];
+         return {slot, _slots[slot].generation};
+      }
+
+      // Handle of the element in <slot>, the slot must be used
+      Handle getSlotHandle(uint32_t slot) const {
+         return {slot, _slots[slot].generation};
+      }
+
+      unsigned size() const { return _denseToSlot.size(); }
+
+      // Makes room for <count> elements
+      void reserve(unsigned count) {
+         _denseToSlot.reserve(count);
+         _slots.reserve(count);
+      }
+
+      // Unregisters every element, outstanding handles become invalid
+      void clear() {
+         unsigned hole, last;
+         while (!_denseToSlot.empty())
+            remove(getHandle(_denseToSlot.size() - 1), &hole, &last);
+      }
+
+   private:
+      // Dense index of the element when the slot is used, index of the next
+      // free slot otherwise
+      typedef struct slot_t {
+         uint32_t index;
+         uint32_t generation;
+      } Slot;
+
+      std::vector<uint32_t> _denseToSlot;
+      std::vector<Slot> _slots;
+      uint32_t _freeSlot;
+};
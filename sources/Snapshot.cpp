@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Snapshot.h"
+extern "C" {
+#include "chipmunk/chipmunk_private.h"
+}
+
+// Start of the files, and version of their layout
+const char SNAPSHOT_MAGIC[4] = {'B', 'S', 'N', 'P'};
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// Functions declarations =====================================================
+
+/**
+ * @brief Identifier of <shape> in a snapshot : index of its ball, or -1 - i
+ * for the wall i
+ */
+int32_t getShapeId(const cpShape* shape, const BallStore& balls, cpShape* const* walls);
+
+/**
+ * @brief Shape of <id> in the restored space
+ *
+ * @return NULL the id matches no shape
+ */
+cpShape* getShape(int32_t id, const BallStore& balls, cpShape* const* walls);
+
+// Appends <arbiter> and its contacts to the snapshot arrays
+void captureArbiter(const cpArbiter* arbiter, const BallStore& balls, cpShape* const* walls,
+                    std::vector<SnapshotArbiter>* arbiters, std::vector<SnapshotContact>* contacts);
+
+/**
+ * @brief Transformation function of cpHashSetInsert creating the arbiter of
+ * a pair of shapes, from the pool of the space as the space itself does
+ */
+void* newArbiter(cpShape** shapes, cpSpace* space);
+
+// Whether the array of <count> records of <size> bytes at <offset> fits
+// in a file of <fileSize> bytes
+bool fitsIn(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize);
+
+// Functions definitions ======================================================
+
+int32_t getShapeId(const cpShape* shape, const BallStore& balls, cpShape* const* walls) {
+   for (int i = 0; i < SNAPSHOT_WALLS; i++) {
+      if (shape == walls[i])
+         return -1 - i;
+   }
+   return balls.getIndex(balls.getHandle(shape));
+}
+
+cpShape* getShape(int32_t id, const BallStore& balls, cpShape* const* walls) {
+   if (id < 0)
+      return id >= -SNAPSHOT_WALLS ? walls[-1 - id] : NULL;
+   return (unsigned) id < balls.size() ? balls.getShape(id) : NULL;
+}
+
+void captureArbiter(const cpArbiter* arbiter, const BallStore& balls, cpShape* const* walls,
+                    std::vector<SnapshotArbiter>* arbiters, std::vector<SnapshotContact>* contacts) {
+   SnapshotArbiter record;
+   record.shapeA = getShapeId(arbiter->a, balls, walls);
+   record.shapeB = getShapeId(arbiter->b, balls, walls);
+   record.firstContact = contacts->size();
+   record.count = arbiter->count;
+   if (record.count == 0)
+      return;
+
+   arbiters->push_back(record);
+   for (int i = 0; i < arbiter->count; i++)
+      contacts->push_back({arbiter->contacts[i].hash, arbiter->contacts[i].jnAcc, arbiter->contacts[i].jtAcc});
+}
+
+void* newArbiter(cpShape** shapes, cpSpace* space) {
+   // Same as cpSpaceArbiterSetTrans, which chipmunk does not export : the
+   // pool is refilled by blocks owned by the space
+   if (space->pooledArbiters->num == 0) {
+      int count = CP_BUFFER_BYTES / sizeof(cpArbiter);
+      cpArbiter* buffer = (cpArbiter*) cpcalloc(1, CP_BUFFER_BYTES);
+      cpArrayPush(space->allocatedBuffers, buffer);
+      for (int i = 0; i < count; i++)
+         cpArrayPush(space->pooledArbiters, buffer + i);
+   }
+   return cpArbiterInit((cpArbiter*) cpArrayPop(space->pooledArbiters), shapes[0], shapes[1]);
+}
+
+bool fitsIn(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize) {
+   return offset % 8 == 0 && offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+bool SnapshotFile::open(const char* path) {
+   close();
+   int file = ::open(path, O_RDONLY);
+   if (file < 0) {
+      fprintf(stderr, "Could not open %s\n", path);
+      return false;
+   }
+   struct stat status;
+   void* data = MAP_FAILED;
+   if (fstat(file, &status) == 0 && status.st_size > 0)
+      data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+   // The mapping stays valid once the file is closed
+   ::close(file);
+   if (data == MAP_FAILED) {
+      fprintf(stderr, "Could not map %s\n", path);
+      return false;
+   }
+   _data = (const uint8_t*) data;
+   _size = status.st_size;
+
+   const SnapshotHeader& header = getHeader();
+   if (_size < sizeof(SnapshotHeader) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+      fprintf(stderr, "%s is not a snapshot\n", path);
+      close();
+      return false;
+   }
+   if (header.version != SNAPSHOT_VERSION || header.headerSize != sizeof(SnapshotHeader)
+       || header.floatSize != sizeof(cpFloat)) {
+      fprintf(stderr, "%s was written by another version\n", path);
+      close();
+      return false;
+   }
+   if (!fitsIn(header.ballsOffset, header.ballCount, sizeof(SnapshotBall), _size)
+       || !fitsIn(header.arbitersOffset, header.arbiterCount, sizeof(SnapshotArbiter), _size)
+       || !fitsIn(header.contactsOffset, header.contactCount, sizeof(SnapshotContact), _size)) {
+      fprintf(stderr, "%s is corrupted\n", path);
+      close();
+      return false;
+   }
+   // The bodies and shapes of the balls are created from these
+   const SnapshotBall* balls = getBalls();
+   for (uint64_t i = 0; i < header.ballCount; i++) {
+      if (balls[i].mass <= 0 || balls[i].radius <= 0) {
+         fprintf(stderr, "%s has a ball of mass %d and radius %d\n", path, balls[i].mass, balls[i].radius);
+         close();
+         return false;
+      }
+   }
+   return true;
+}
+
+void SnapshotFile::close() {
+   if (_data)
+      munmap((void*) _data, _size);
+   _data = NULL;
+   _size = 0;
+}
+
+bool writeSnapshot(const char* path, SnapshotHeader header, const std::vector<SnapshotBall>& balls,
+                   const std::vector<SnapshotArbiter>& arbiters, const std::vector<SnapshotContact>& contacts) {
+   memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+   header.version = SNAPSHOT_VERSION;
+   header.headerSize = sizeof(SnapshotHeader);
+   header.floatSize = sizeof(cpFloat);
+   header.ballCount = balls.size();
+   header.arbiterCount = arbiters.size();
+   header.contactCount = contacts.size();
+   header.ballsOffset = sizeof(SnapshotHeader);
+   header.arbitersOffset = header.ballsOffset + balls.size() * sizeof(SnapshotBall);
+   header.contactsOffset = header.arbitersOffset + arbiters.size() * sizeof(SnapshotArbiter);
+
+   FILE* file = fopen(path, "wb");
+   if (!file) {
+      fprintf(stderr, "Could not open %s for writing\n", path);
+      return false;
+   }
+   bool written = fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(balls.data(), sizeof(SnapshotBall), balls.size(), file) == balls.size()
+      && fwrite(arbiters.data(), sizeof(SnapshotArbiter), arbiters.size(), file) == arbiters.size()
+      && fwrite(contacts.data(), sizeof(SnapshotContact), contacts.size(), file) == contacts.size();
+   written = fclose(file) == 0 && written;
+   if (!written)
+      fprintf(stderr, "Could not write %s\n", path);
+   return written;
+}
+
+void captureArbiters(cpSpace* space, const BallStore& balls, cpShape* const* walls,
+                     std::vector<SnapshotArbiter>* arbiters, std::vector<SnapshotContact>* contacts) {
+   cpArray* active = space->arbiters;
+   for (int i = 0; i < active->num; i++)
+      captureArbiter((cpArbiter*) active->arr[i], balls, walls, arbiters, contacts);
+
+   // Sleeping bodies keep their arbiters in their own lists, each one is
+   // taken once, from its first body unless that one is static
+   cpArray* components = space->sleepingComponents;
+   for (int i = 0; i < components->num; i++) {
+      for (cpBody* body = (cpBody*) components->arr[i]; body; body = body->sleeping.next) {
+         for (cpArbiter* arbiter = body->arbiterList; arbiter; arbiter = cpArbiterNext(arbiter, body)) {
+            if (body == arbiter->body_a || cpBodyGetType(arbiter->body_a) == CP_BODY_TYPE_STATIC)
+               captureArbiter(arbiter, balls, walls, arbiters, contacts);
+         }
+      }
+   }
+}
+
+void restoreArbiters(cpSpace* space, const BallStore& balls, cpShape* const* walls,
+                     const SnapshotArbiter* arbiters, unsigned arbiterCount,
+                     const SnapshotContact* contacts, unsigned contactCount) {
+   cpSpacePushFreshContactBuffer(space);
+   for (unsigned i = 0; i < arbiterCount; i++) {
+      const SnapshotArbiter& record = arbiters[i];
+      cpShape* shapes[] = {getShape(record.shapeA, balls, walls), getShape(record.shapeB, balls, walls)};
+      if (!shapes[0] || !shapes[1] || shapes[0] == shapes[1]
+          || record.count == 0 || record.count > CP_MAX_CONTACTS_PER_ARBITER
+          || record.firstContact > contactCount || record.count > contactCount - record.firstContact)
+         continue;
+
+      // The space finds the arbiters of the colliding shapes by the pair of
+      // their addresses. A pair already restored is left as it is.
+      cpHashValue hash = CP_HASH_PAIR((cpHashValue) shapes[0], (cpHashValue) shapes[1]);
+      cpArbiter* arbiter = (cpArbiter*) cpHashSetInsert(space->cachedArbiters, hash, shapes,
+                                                        (cpHashSetTransFunc) newArbiter, space);
+      if (arbiter->count != 0)
+         continue;
+
+      arbiter->contacts = cpContactBufferGetArray(space);
+      arbiter->count = record.count;
+      memset(arbiter->contacts, 0, record.count * sizeof(struct cpContact));
+      for (unsigned j = 0; j < record.count; j++) {
+         const SnapshotContact& contact = contacts[record.firstContact + j];
+         arbiter->contacts[j].hash = contact.hash;
+         arbiter->contacts[j].jnAcc = contact.jnAcc;
+         arbiter->contacts[j].jtAcc = contact.jtAcc;
+      }
+      cpSpacePushContacts(space, record.count);
+
+      // Cached arbiters past their first collision get their impulses
+      // applied back. The handlers are replaced on the next collision.
+      arbiter->state = CP_ARBITER_STATE_NORMAL;
+      arbiter->stamp = space->stamp;
+      arbiter->handler = &space->defaultHandler;
+      arbiter->handlerA = arbiter->handlerB = &cpCollisionHandlerDoNothing;
+   }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "chipmunk/chipmunk.h"
+#include "Ball.h"
+#include "BallStore.h"
+
+/*
+ * A snapshot file is a header followed by flat arrays of fixed size records,
+ * in the byte order of the machine that wrote it :
+ *    SnapshotHeader
+ *    SnapshotBall[ballCount]         at ballsOffset
+ *    SnapshotArbiter[arbiterCount]   at arbitersOffset
+ *    SnapshotContact[contactCount]   at contactsOffset
+ * Every record is a multiple of 8 bytes long, so that the arrays are read in
+ * place from the mapped file.
+ */
+
+// Number of walls of a snapshot
+const int SNAPSHOT_WALLS = 4;
+
+typedef struct snapshot_header_t {
+   char magic[4];          // "BSNP"
+   uint32_t version;
+   uint32_t headerSize;    // sizeof(SnapshotHeader), catches layout changes
+   uint32_t floatSize;     // sizeof(cpFloat)
+   int32_t width, height;
+   uint64_t stepCount;
+   Segment walls[SNAPSHOT_WALLS];
+   // Index of the ball linked to the mouse, -1 if there is none, and the
+   // anchors of the pivot joint on the ball and in the world
+   int32_t linkedBall;
+   uint32_t padding;
+   cpVect linkAnchorA, linkAnchorB;
+   uint64_t ballCount, arbiterCount, contactCount;
+   uint64_t ballsOffset, arbitersOffset, contactsOffset;
+} SnapshotHeader;
+
+typedef struct snapshot_ball_t {
+   cpVect position, velocity;
+   cpFloat angle, angularVelocity;
+   // Corrections of the overlaps found by the last step, added to the
+   // velocities when integrating the next positions
+   cpVect velocityBias;
+   cpFloat angularVelocityBias;
+   cpFloat friction, elasticity;
+   int32_t mass, radius;
+   Color color;
+   uint32_t padding;
+} SnapshotBall;
+
+/**
+ * @brief Pair of colliding shapes cached by the space. A shape is the index
+ * of its ball, or -1 - i for the wall i.
+ */
+typedef struct snapshot_arbiter_t {
+   int32_t shapeA, shapeB;
+   uint32_t firstContact, count;
+} SnapshotArbiter;
+
+// Impulses accumulated by a contact, used to warm start the solver
+typedef struct snapshot_contact_t {
+   uint64_t hash;
+   cpFloat jnAcc, jtAcc;
+} SnapshotContact;
+
+/**
+ * @brief Read-only view of a snapshot file, mapped in memory
+ */
+class SnapshotFile {
+   public:
+      SnapshotFile(): _data(NULL), _size(0) {}
+      ~SnapshotFile() { close(); }
+      SnapshotFile(const SnapshotFile&) = delete;
+      SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+      /**
+       * @brief Maps the file at <path> and checks its header, the bounds of
+       * its arrays and the masses and radii of its balls
+       *
+       * @return false the file could not be mapped or is not a valid snapshot
+       */
+      bool open(const char* path);
+      void close();
+
+      const SnapshotHeader& getHeader() const { return *(const SnapshotHeader*) _data; }
+      const SnapshotBall* getBalls() const { return (const SnapshotBall*) (_data + getHeader().ballsOffset); }
+      const SnapshotArbiter* getArbiters() const { return (const SnapshotArbiter*) (_data + getHeader().arbitersOffset); }
+      const SnapshotContact* getContacts() const { return (const SnapshotContact*) (_data + getHeader().contactsOffset); }
+
+   private:
+      const uint8_t* _data;
+      size_t _size;
+};
+
+/**
+ * @brief Writes a snapshot made of <header> and of the given arrays. The
+ * magic, version, sizes, counts and offsets of the header are filled here.
+ *
+ * @return false the file could not be written
+ */
+bool writeSnapshot(const char* path, SnapshotHeader header, const std::vector<SnapshotBall>& balls,
+                   const std::vector<SnapshotArbiter>& arbiters, const std::vector<SnapshotContact>& contacts);
+
+/**
+ * @brief Collects the arbiters of <space> between its balls and its walls,
+ * with the impulses of their contacts. The arbiters of the last step and
+ * the ones kept by sleeping bodies are taken.
+ */
+void captureArbiters(cpSpace* space, const BallStore& balls, cpShape* const* walls,
+                     std::vector<SnapshotArbiter>* arbiters, std::vector<SnapshotContact>* contacts);
+
+/**
+ * @brief Puts the arbiters of a snapshot back into the cache of <space>, as
+ * if their shapes had been touching for a while, so that the next step
+ * starts from their impulses instead of from zero. The space must not have
+ * been stepped since its balls were added. Invalid records are skipped.
+ */
+void restoreArbiters(cpSpace* space, const BallStore& balls, cpShape* const* walls,
+                     const SnapshotArbiter* arbiters, unsigned arbiterCount,
+                     const SnapshotContact* contacts, unsigned contactCount);
@@ -0,0 +1,106 @@
+#include "TextRenderer.h"
+#include "Trace.h"
+
+TextRenderer::TextRenderer(): _lineHeight(0) {
+   for (int i = 0; i < NB_GLYPHS; i++)
+      _glyphs[i] = {0, 0, 0, 0};
+}
+
+bool TextRenderer::load(std::string fontFile, int size, SDL_Renderer* renderer) {
+   TraceScope trace("text atlas");
+   free();
+
+   TTF_Font* font = TTF_OpenFont(fontFile.c_str(), size);
+   if (!font) {
+      printf("Can't load font. Error : %s\n", TTF_GetError());
+      return false;
+   }
+
+   // Each glyph is rendered alone, so that its surface is as wide as its
+   // advance and as high as a line of text
+   SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+   SDL_Surface* glyphs[NB_GLYPHS];
+   int x = 0, y = 0, rowHeight = 0;
+   for (int i = 0; i < NB_GLYPHS; i++) {
+      char text[2] = {(char) (FIRST_GLYPH + i), '\0'};
+      glyphs[i] = TTF_RenderText_Blended(font, text, white);
+      if (!glyphs[i])
+         continue;
+
+      // Shelf packing
+      if (x + glyphs[i]->w > ATLAS_WIDTH) {
+         x = 0;
+         y += rowHeight;
+         rowHeight = 0;
+      }
+      _glyphs[i] = {x, y, glyphs[i]->w, glyphs[i]->h};
+      x += glyphs[i]->w;
+      if (glyphs[i]->h > rowHeight)
+         rowHeight = glyphs[i]->h;
+   }
+   _lineHeight = TTF_FontHeight(font);
+   TTF_CloseFont(font);
+
+   SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, y + rowHeight, 32, SDL_PIXELFORMAT_RGBA32);
+   if (atlas) {
+      for (int i = 0; i < NB_GLYPHS; i++) {
+         if (!glyphs[i])
+            continue;
+         // Copies the alpha channel as is instead of blending it
+         SDL_SetSurfaceBlendMode(glyphs[i], SDL_BLENDMODE_NONE);
+         SDL_BlitSurface(glyphs[i], NULL, atlas, &_glyphs[i]);
+      }
+      _atlas.loadFromSurface(atlas, renderer);
+      SDL_FreeSurface(atlas);
+   } else
+      printf("Could not create the glyph atlas surface. Error : %s\n", SDL_GetError());
+
+   for (int i = 0; i < NB_GLYPHS; i++)
+      if (glyphs[i])
+         SDL_FreeSurface(glyphs[i]);
+
+   return _atlas.getWidth() != 0;
+}
+
+void TextRenderer::free() {
+   _atlas.free();
+}
+
+void TextRenderer::render(SDL_Renderer* renderer, const char* text, int x, int y, SDL_Color color) {
+   TraceScope trace("text");
+   if (_atlas.getWidth() == 0)
+      return;
+
+   float atlasWidth = _atlas.getWidth(), atlasHeight = _atlas.getHeight();
+   _vertices.clear();
+   _indices.clear();
+   for (const char* c = text; *c; c++) {
+      if (*c < FIRST_GLYPH || *c > LAST_GLYPH)
+         continue;
+      const SDL_Rect& glyph = _glyphs[*c - FIRST_GLYPH];
+
+      // Quad of the glyph, corners in clockwise order from the top left one
+      int first = _vertices.size();
+      for (int corner = 0; corner < 4; corner++) {
+         int right = (corner == 1 || corner == 2), bottom = (corner >= 2);
+         SDL_Vertex vertex;
+         vertex.position.x = x + right * glyph.w;
+         vertex.position.y = y + bottom * glyph.h;
+         vertex.color = color;
+         vertex.tex_coord.x = (glyph.x + right * glyph.w) / atlasWidth;
+         vertex.tex_coord.y = (glyph.y + bottom * glyph.h) / atlasHeight;
+         _vertices.push_back(vertex);
+      }
+      _indices.push_back(first);
+      _indices.push_back(first + 1);
+      _indices.push_back(first + 2);
+      _indices.push_back(first);
+      _indices.push_back(first + 2);
+      _indices.push_back(first + 3);
+
+      x += glyph.w;
+   }
+
+   if (!_indices.empty())
+      _atlas.renderGeometry(renderer, _vertices.data(), _vertices.size(), _indices.data(), _indices.size());
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "Texture.h"
+
+/**
+ * @brief Draws text from a glyph atlas. Every printable ASCII character of
+ * the font is rasterized once into a single texture when loading, strings
+ * are then drawn as a batch of textured quads without any surface or
+ * texture allocation, which suits text that changes every frame.
+ */
+class TextRenderer {
+   public:
+      TextRenderer();
+
+      /**
+       * @brief Rasterizes the glyphs of <fontFile> at <size> points into the
+       * atlas
+       *
+       * @return true the atlas is ready
+       * @return false the font or the atlas could not be created
+       */
+      bool load(std::string fontFile, int size, SDL_Renderer* renderer);
+
+      // Releases the atlas, must be called before the renderer is destroyed
+      void free();
+
+      /**
+       * @brief Renders a single line of text, characters missing from the
+       * atlas are skipped
+       *
+       * @param text the string to draw
+       * @param x left of the text
+       * @param y top of the text
+       * @param color color of the text
+       */
+      void render(SDL_Renderer* renderer, const char* text, int x, int y, SDL_Color color);
+
+      int getLineHeight() const { return _lineHeight; }
+
+   private:
+      static const char FIRST_GLYPH = ' ';
+      static const char LAST_GLYPH = '~';
+      static const int NB_GLYPHS = LAST_GLYPH - FIRST_GLYPH + 1;
+      static const int ATLAS_WIDTH = 512;
+
+      Texture _atlas;
+      // Area of each glyph in the atlas, its width being its advance
+      SDL_Rect _glyphs[NB_GLYPHS];
+      int _lineHeight;
+
+      // Kept between calls so that their memory is reused
+      std::vector<SDL_Vertex> _vertices;
+      std::vector<int> _indices;
+};
@@ -2,7 +2,6 @@
 
 Texture::Texture() {
 	_texture = NULL;
-   _font = NULL;
 	_width = 0;
 	_height = 0;
    _x = _y = 0;
@@ -12,35 +11,43 @@ Texture::~Texture() {
 	free();
 }
 
-bool Texture::initFont(std::string fontFile) {
-   _font = TTF_OpenFont(fontFile.c_str(), 20);
-   if (!_font) {
-      printf("Can't load font. Error : %s\n", TTF_GetError());
+bool Texture::loadFromSurface(SDL_Surface* surface, SDL_Renderer* renderer) {
+   free();
+
+   _texture = SDL_CreateTextureFromSurface(renderer, surface);
+   if (!_texture) {
+      printf("Unable to create texture from surface. Error : %s\n", SDL_GetError());
       return false;
    }
+   _width = surface->w;
+   _height = surface->h;
+
    return true;
 }
 
-bool Texture::loadFromRenderedText(std::string textureText, SDL_Color textColor, SDL_Renderer* renderer) {
-	// Get rid of another loaded text if there is one
-	free();
+bool Texture::createRenderTarget(int width, int height, SDL_Renderer* renderer) {
+   free();
 
-	SDL_Surface* textSurface = TTF_RenderText_Blended(_font, textureText.c_str(), textColor);
-	if (!textSurface) {
-		printf("Could not render text surface. SDL_ttf error : %s\n", TTF_GetError());
-	} else {
-		_texture = SDL_CreateTextureFromSurface(renderer, textSurface);
-		if (_texture == NULL) {
-			printf("Unable to create texture from rendered text. Error : %s\n", SDL_GetError());
-		} else {
-			_width = textSurface->w;
-			_height = textSurface->h;
-		}
-
-		SDL_FreeSurface(textSurface);
-	}
+   _texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height);
+   if (!_texture) {
+      printf("Unable to create target texture. Error : %s\n", SDL_GetError());
+      return false;
+   }
+   _width = width;
+   _height = height;
+   SDL_SetTextureBlendMode(_texture, SDL_BLENDMODE_BLEND);
+
+   // Starts fully transparent
+   setAsRenderTarget(renderer, true);
+   SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
+   SDL_RenderClear(renderer);
+   setAsRenderTarget(renderer, false);
+
+   return true;
+}
 
-	return _texture != NULL;
+void Texture::setAsRenderTarget(SDL_Renderer* renderer, bool target) {
+   SDL_SetRenderTarget(renderer, target ? _texture : NULL);
 }
 
 void Texture::free() {
@@ -56,6 +63,10 @@ void Texture::setColor(Uint8 red, Uint8 green, Uint8 blue) {
 	SDL_SetTextureColorMod(_texture, red, green, blue);
 }
 
+void Texture::setAlpha(Uint8 alpha) {
+   SDL_SetTextureAlphaMod(_texture, alpha);
+}
+
 void Texture::setBlendMode(SDL_BlendMode blending) {
 	SDL_SetTextureBlendMode(_texture, blending);
 }
@@ -68,6 +79,14 @@ void Texture::render(SDL_Renderer* renderer) {
 	SDL_RenderCopyEx(renderer, _texture, NULL, &renderQuad, 0, NULL, SDL_FLIP_NONE);
 }
 
+void Texture::renderClip(SDL_Renderer* renderer, const SDL_Rect* clip, const SDL_FRect* destination, double angle) {
+   SDL_RenderCopyExF(renderer, _texture, clip, destination, angle, NULL, SDL_FLIP_NONE);
+}
+
+void Texture::renderGeometry(SDL_Renderer* renderer, const SDL_Vertex* vertices, int nbVertices, const int* indices, int nbIndices) {
+   SDL_RenderGeometry(renderer, _texture, vertices, nbVertices, indices, nbIndices);
+}
+
 int Texture::getWidth() {
 	return _width;
 }
@@ -1,7 +1,6 @@
 #pragma once
 #include <string>
 #include <SDL2/SDL_image.h>
-#include <SDL2/SDL_ttf.h>
 
 class Texture {
 	public:
@@ -11,10 +10,15 @@ class Texture {
 		// Désalloue la mémoire
 		~Texture();
 
-      bool initFont(std::string fontFile);
+      // Creates the texture from the pixels of a surface
+      bool loadFromSurface(SDL_Surface* surface, SDL_Renderer* renderer);
 
-		//Creates image from font string
-      bool loadFromRenderedText(std::string textureText, SDL_Color textColor, SDL_Renderer* renderer);
+      // Creates a transparent texture the renderer can draw into
+      bool createRenderTarget(int width, int height, SDL_Renderer* renderer);
+
+      // Redirects the renderer drawing to the texture, or back to the window
+      // when <target> is false
+      void setAsRenderTarget(SDL_Renderer* renderer, bool target);
 
 		// Désalloue la mémoire de la texture
 		void free();
@@ -22,12 +26,27 @@ class Texture {
 		// Change le modificateur de couleur
 		void setColor(Uint8 red, Uint8 green, Uint8 blue);
 
+      // Change le modificateur d'opacité
+      void setAlpha(Uint8 alpha);
+
 		//Set blending
       void setBlendMode(SDL_BlendMode blending);
 
 		// Affiche la texture à certaines coordonnées donné
 		void render(SDL_Renderer* renderer);
 
+      /**
+       * @brief Renders the <clip> part of the texture into <destination>,
+       * rotated by <angle> degrees clockwise around its center
+       */
+      void renderClip(SDL_Renderer* renderer, const SDL_Rect* clip, const SDL_FRect* destination, double angle);
+
+      /**
+       * @brief Renders triangles textured with the whole texture, texture
+       * coordinates of the vertices being normalized
+       */
+      void renderGeometry(SDL_Renderer* renderer, const SDL_Vertex* vertices, int nbVertices, const int* indices, int nbIndices);
+
 		// Accesseurs de la texture
 		int getWidth();
 		int getHeight();
@@ -35,7 +54,6 @@ class Texture {
       void setPosition(int x, int y) { _x = x; _y = y; }
 
 	private:
-      TTF_Font* _font;
 		SDL_Texture* _texture;
 
 		// Dimensions de l'image
@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+
+// Number of checks a worker makes for a new loop before sleeping
+const int SPIN_COUNT = 4096;
+
+ThreadPool::ThreadPool(unsigned threads):
+   _quit(false), _generation(0), _next(0), _busy(0),
+   _task(NULL), _data(NULL), _count(0), _grain(1), _stealing(false), _shares(threads) {
+   for (unsigned i = 1; i < threads; i++)
+      _workers.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _quit = true;
+      ++ _generation;
+   }
+   _wakeUp.notify_all();
+   for (unsigned i = 0; i < _workers.size(); i++)
+      _workers[i].join();
+}
+
+void ThreadPool::run(Task task, void* data, unsigned count, unsigned grain) {
+   if (count == 0)
+      return;
+   if (_workers.empty() || count <= grain) {
+      task(data, 0, count);
+      return;
+   }
+
+   _task = task;
+   _data = data;
+   _count = count;
+   _grain = grain;
+   _stealing = false;
+   _next.store(0, std::memory_order_relaxed);
+   dispatch();
+}
+
+void ThreadPool::runStealing(Task task, void* data, unsigned count) {
+   if (count == 0)
+      return;
+   if (_workers.empty() || count == 1) {
+      for (unsigned i = 0; i < count; i++)
+         task(data, i, i + 1);
+      return;
+   }
+
+   _task = task;
+   _data = data;
+   _count = count;
+   _stealing = true;
+   unsigned threads = _shares.size();
+   for (unsigned i = 0; i < threads; i++) {
+      uint64_t front = (uint64_t) count * i / threads;
+      uint64_t back = (uint64_t) count * (i + 1) / threads;
+      _shares[i].bounds.store(front << 32 | back, std::memory_order_relaxed);
+   }
+   dispatch();
+}
+
+void ThreadPool::dispatch() {
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _busy.store(_workers.size(), std::memory_order_relaxed);
+      _generation.fetch_add(1, std::memory_order_release);
+   }
+   _wakeUp.notify_all();
+
+   if (_stealing)
+      runShare(0);
+   else
+      runChunks();
+   while (_busy.load(std::memory_order_acquire) != 0)
+      std::this_thread::yield();
+}
+
+void ThreadPool::work(unsigned thread) {
+   unsigned seen = 0;
+   while (true) {
+      // Waits for the next loop, spinning first
+      int spins = 0;
+      while (_generation.load(std::memory_order_acquire) == seen && spins < SPIN_COUNT) {
+         std::this_thread::yield();
+         ++ spins;
+      }
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _wakeUp.wait(lock, [&]() { return _generation.load(std::memory_order_acquire) != seen; });
+         if (_quit)
+            return;
+         seen = _generation.load(std::memory_order_acquire);
+      }
+
+      if (_stealing)
+         runShare(thread);
+      else
+         runChunks();
+      _busy.fetch_sub(1, std::memory_order_release);
+   }
+}
+
+void ThreadPool::runChunks() {
+   while (true) {
+      unsigned begin = _next.fetch_add(_grain, std::memory_order_relaxed);
+      if (begin >= _count)
+         return;
+      unsigned end = begin + _grain < _count ? begin + _grain : _count;
+      _task(_data, begin, end);
+   }
+}
+
+void ThreadPool::runShare(unsigned thread) {
+   unsigned item;
+   while (takeItem(_shares[thread], true, &item))
+      _task(_data, item, item + 1);
+
+   // Own share done : steal from the others, until they are all empty
+   unsigned threads = _shares.size();
+   for (unsigned i = 1; i < threads; i++) {
+      Share& victim = _shares[(thread + i) % threads];
+      while (takeItem(victim, false, &item))
+         _task(_data, item, item + 1);
+   }
+}
+
+bool ThreadPool::takeItem(Share& share, bool front, unsigned* item) {
+   uint64_t bounds = share.bounds.load(std::memory_order_relaxed);
+   while (true) {
+      uint32_t first = bounds >> 32, last = (uint32_t) bounds;
+      if (first >= last)
+         return false;
+
+      uint64_t taken = front ? (uint64_t) (first + 1) << 32 | last : (uint64_t) first << 32 | (last - 1);
+      if (share.bounds.compare_exchange_weak(bounds, taken, std::memory_order_relaxed)) {
+         *item = front ? first : last - 1;
+         return true;
+      }
+   }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief Fixed set of worker threads running parallel loops. The calling
+ * thread takes part in each loop, so a pool of N threads only starts N - 1
+ * workers. Between loops the workers spin for a short while before going to
+ * sleep, a step runs many short loops in a row.
+ *
+ * Loops are either split into chunks taken in order by the threads, or,
+ * for items of uneven costs, shared out between the threads which steal
+ * items from the others once they are done with their own.
+ */
+class ThreadPool {
+   public:
+      // Body of a loop, called for the items [begin, end) of <data>
+      typedef void (*Task)(void* data, unsigned begin, unsigned end);
+
+      /**
+       * @param threads number of threads running the loops, caller included
+       */
+      ThreadPool(unsigned threads);
+      ~ThreadPool();
+
+      /**
+       * @brief Runs <task> over the items [0, count) split into chunks of
+       * <grain> items, and returns once every chunk is done. Loops smaller
+       * than a chunk are run by the caller alone.
+       */
+      void run(Task task, void* data, unsigned count, unsigned grain);
+
+      /**
+       * @brief Runs <task> once for each item of [0, count), and returns once
+       * every item is done. Each thread starts with a contiguous share of the
+       * items, from its front, and steals from the back of the other shares
+       * once its own is empty.
+       */
+      void runStealing(Task task, void* data, unsigned count);
+
+      unsigned getThreadCount() const { return _workers.size() + 1; }
+
+   private:
+      // Items [front, back) left in the share of a thread, packed so that
+      // the owner and the thieves can update them with a single CAS
+      typedef struct alignas(64) share_t {
+         std::atomic<uint64_t> bounds;
+      } Share;
+
+      // Sends the current loop to the workers, runs its part and waits
+      void dispatch();
+      void work(unsigned thread);
+      // Takes chunks of the current loop until there are none left
+      void runChunks();
+      // Empties the share of <thread>, then the ones of the other threads
+      void runShare(unsigned thread);
+      // Takes an item from the front or the back of <share>
+      bool takeItem(Share& share, bool front, unsigned* item);
+
+      std::vector<std::thread> _workers;
+
+      std::mutex _mutex;
+      std::condition_variable _wakeUp;
+      bool _quit;
+
+      // Bumped for each loop, workers wait for it to change
+      std::atomic<unsigned> _generation;
+      // Next item to take and workers still busy with the current loop
+      std::atomic<unsigned> _next;
+      std::atomic<unsigned> _busy;
+
+      Task _task;
+      void* _data;
+      unsigned _count, _grain;
+      bool _stealing;
+      std::vector<Share> _shares;
+};
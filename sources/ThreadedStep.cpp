@@ -0,0 +1,528 @@
+#include <string.h>
+#include "ThreadedStep.h"
+#include "Trace.h"
+// The private header does not declare its functions as C ones
+extern "C" {
+#include "chipmunk/chipmunk_private.h"
+}
+
+const char* SOLVER_MODE_NAMES[NB_SOLVER_MODES] = {"colors", "islands"};
+const char* STEP_PHASE_NAMES[NB_STEP_PHASES] = {
+   "positions", "broadphase", "narrowphase", "components", "prestep", "velocities", "solver", "callbacks"
+};
+
+// Items per chunk of the parallel loops
+const unsigned BODIES_GRAIN = 512;
+const unsigned ARBITERS_GRAIN = 256;
+
+// Colors with fewer arbiters are solved by the calling thread alone, waking
+// the workers and waiting for them would cost more than the split saves
+const unsigned COLOR_PARALLEL_MIN = 4 * ARBITERS_GRAIN;
+
+// Pairs of circles collected before their collision tests
+const unsigned NARROWPHASE_BATCH_SIZE = 512;
+
+// Group of the arbiters and constraints which move no dynamic body
+const unsigned NO_GROUP = UINT32_MAX;
+
+// Parameters of the loops over the bodies
+typedef struct body_loop_t {
+   cpBody** bodies;
+   cpFloat dt, damping;
+   cpVect gravity;
+} BodyLoop;
+
+// Parameters of the loop over the islands
+typedef struct island_loop_t {
+   cpArbiter** arbiters;
+   const unsigned* arbiterStarts;
+   cpConstraint** constraints;
+   const unsigned* constraintStarts;
+   cpFloat dt, dtCoef;
+   int iterations;
+} IslandLoop;
+
+// Loop bodies run by the pool ================================================
+
+void integratePositions(void* data, unsigned begin, unsigned end);
+void integrateVelocities(void* data, unsigned begin, unsigned end);
+void preStepArbiters(void* data, unsigned begin, unsigned end);
+void applyCachedImpulses(void* data, unsigned begin, unsigned end);
+void applyImpulses(void* data, unsigned begin, unsigned end);
+// Same as applyImpulses, vectorized for the runs of single contact arbiters
+void applyImpulsesSimd(void* data, unsigned begin, unsigned end);
+// Cached impulses and iterations of the islands [begin, end)
+void solveIsland(void* data, unsigned begin, unsigned end);
+
+/**
+ * @brief cpSpatialIndexReindexQuery callback, batching the pairs of circles
+ * and colliding the other pairs right away, after the batch
+ */
+cpCollisionID collideBatched(cpShape* a, cpShape* b, cpCollisionID id, NarrowphaseBatch* batch);
+
+/**
+ * @brief Collides the overlapping pairs of the batch, in order, and empties
+ * it
+ */
+void flushBatch(NarrowphaseBatch* batch);
+
+/**
+ * @brief Bodies of the arbiter <i>, or of the constraint <i> - arbiters->num
+ * past the arbiters
+ */
+void getLinkedBodies(cpArray* arbiters, cpArray* constraints, unsigned i, cpBody** a, cpBody** b);
+
+/**
+ * @brief Index of the lowest bit not set in <colors>, MAX_COLORS if there is
+ * none
+ */
+int firstFreeColor(uint64_t colors);
+
+/**
+ * @brief Seconds elapsed since <*start>, which is moved to now so that
+ * consecutive phases are timed one after the other. The span is traced
+ * under <name>, unless it is NULL.
+ */
+double lap(TraceClock::time_point* start, const char* name);
+
+void integratePositions(void* data, unsigned begin, unsigned end) {
+   BodyLoop* loop = (BodyLoop*) data;
+   for (unsigned i = begin; i < end; i++)
+      loop->bodies[i]->position_func(loop->bodies[i], loop->dt);
+}
+
+void integrateVelocities(void* data, unsigned begin, unsigned end) {
+   BodyLoop* loop = (BodyLoop*) data;
+   for (unsigned i = begin; i < end; i++)
+      loop->bodies[i]->velocity_func(loop->bodies[i], loop->gravity, loop->damping, loop->dt);
+}
+
+void preStepArbiters(void* data, unsigned begin, unsigned end) {
+   ArbiterLoop* loop = (ArbiterLoop*) data;
+   for (unsigned i = begin; i < end; i++)
+      cpArbiterPreStep(loop->arbiters[i], loop->dt, loop->slop, loop->biasCoef);
+}
+
+void applyCachedImpulses(void* data, unsigned begin, unsigned end) {
+   ArbiterLoop* loop = (ArbiterLoop*) data;
+   for (unsigned i = begin; i < end; i++)
+      cpArbiterApplyCachedImpulse(loop->arbiters[i], loop->dtCoef);
+}
+
+void applyImpulses(void* data, unsigned begin, unsigned end) {
+   ArbiterLoop* loop = (ArbiterLoop*) data;
+   for (unsigned i = begin; i < end; i++)
+      cpArbiterApplyImpulse(loop->arbiters[i]);
+}
+
+void applyImpulsesSimd(void* data, unsigned begin, unsigned end) {
+   ArbiterLoop* loop = (ArbiterLoop*) data;
+   unsigned i = begin;
+   while (i < end) {
+      bool vectorizable = i + SIMD_WIDTH <= end;
+      for (int k = 0; k < SIMD_WIDTH && vectorizable; k++)
+         vectorizable = loop->arbiters[i + k]->count == 1;
+
+      if (vectorizable) {
+         applyImpulses4(loop->arbiters + i);
+         i += SIMD_WIDTH;
+      } else {
+         cpArbiterApplyImpulse(loop->arbiters[i]);
+         ++ i;
+      }
+   }
+}
+
+void solveIsland(void* data, unsigned begin, unsigned end) {
+   IslandLoop* loop = (IslandLoop*) data;
+   for (unsigned island = begin; island < end; island++) {
+      cpArbiter** arbiters = loop->arbiters + loop->arbiterStarts[island];
+      unsigned arbiterCount = loop->arbiterStarts[island + 1] - loop->arbiterStarts[island];
+      cpConstraint** constraints = loop->constraints + loop->constraintStarts[island];
+      unsigned constraintCount = loop->constraintStarts[island + 1] - loop->constraintStarts[island];
+
+      for (unsigned i = 0; i < arbiterCount; i++)
+         cpArbiterApplyCachedImpulse(arbiters[i], loop->dtCoef);
+      for (unsigned i = 0; i < constraintCount; i++)
+         constraints[i]->klass->applyCachedImpulse(constraints[i], loop->dtCoef);
+
+      for (int i = 0; i < loop->iterations; i++) {
+         for (unsigned j = 0; j < arbiterCount; j++)
+            cpArbiterApplyImpulse(arbiters[j]);
+         for (unsigned j = 0; j < constraintCount; j++)
+            constraints[j]->klass->applyImpulse(constraints[j], loop->dt);
+      }
+   }
+}
+
+cpCollisionID collideBatched(cpShape* a, cpShape* b, cpCollisionID id, NarrowphaseBatch* batch) {
+   if (a->klass->type == CP_CIRCLE_SHAPE && b->klass->type == CP_CIRCLE_SHAPE) {
+      // Circle collisions do not use the id, it is given back as is
+      batch->pairs.push_back({a, b, id});
+      if (batch->pairs.size() == NARROWPHASE_BATCH_SIZE)
+         flushBatch(batch);
+      return id;
+   }
+
+   flushBatch(batch);
+   TraceClock::time_point start = TraceClock::now();
+   id = cpSpaceCollideShapes(a, b, id, batch->space);
+   batch->seconds += lap(&start, NULL);
+   return id;
+}
+
+void flushBatch(NarrowphaseBatch* batch) {
+   unsigned count = batch->pairs.size();
+   if (count == 0)
+      return;
+
+   TraceClock::time_point start = TraceClock::now();
+   batch->overlaps.resize(count);
+   if (batch->simd)
+      findCircleOverlaps(batch->pairs.data(), count, batch->overlaps.data());
+   else
+      memset(batch->overlaps.data(), 1, count);
+   for (unsigned i = 0; i < count; i++) {
+      if (batch->overlaps[i])
+         cpSpaceCollideShapes(batch->pairs[i].a, batch->pairs[i].b, batch->pairs[i].id, batch->space);
+   }
+   batch->pairs.clear();
+   batch->seconds += lap(&start, STEP_PHASE_NAMES[PHASE_NARROWPHASE]);
+}
+
+void getLinkedBodies(cpArray* arbiters, cpArray* constraints, unsigned i, cpBody** a, cpBody** b) {
+   if (i < (unsigned) arbiters->num) {
+      *a = ((cpArbiter*) arbiters->arr[i])->body_a;
+      *b = ((cpArbiter*) arbiters->arr[i])->body_b;
+   } else {
+      *a = ((cpConstraint*) constraints->arr[i - arbiters->num])->a;
+      *b = ((cpConstraint*) constraints->arr[i - arbiters->num])->b;
+   }
+}
+
+int firstFreeColor(uint64_t colors) {
+   return ~colors ? __builtin_ctzll(~colors) : ThreadedStep::MAX_COLORS;
+}
+
+double lap(TraceClock::time_point* start, const char* name) {
+   TraceClock::time_point now = TraceClock::now();
+   if (name)
+      traceEvent(name, *start, now);
+   double seconds = std::chrono::duration<double>(now - *start).count();
+   *start = now;
+   return seconds;
+}
+
+const char* getSolverModeName(SolverMode mode) {
+   return SOLVER_MODE_NAMES[mode];
+}
+
+const char* getStepPhaseName(StepPhase phase) {
+   return STEP_PHASE_NAMES[phase];
+}
+
+bool parseSolverMode(const char* name, SolverMode* mode) {
+   for (int i = 0; i < NB_SOLVER_MODES; i++) {
+      if (strcmp(name, SOLVER_MODE_NAMES[i]) == 0) {
+         *mode = (SolverMode) i;
+         return true;
+      }
+   }
+   return false;
+}
+
+// ThreadedStep ===============================================================
+
+ThreadedStep::ThreadedStep(unsigned threads, SolverMode mode, bool simd):
+   _pool(threads), _mode(mode), _simd(simd && hasSimdSupport()), _phaseTimes(), _bodyCount(0) {
+   _batch.space = NULL;
+   _batch.pairs.reserve(NARROWPHASE_BATCH_SIZE);
+   _batch.simd = _simd;
+   _batch.seconds = 0;
+}
+
+void ThreadedStep::step(cpSpace* space, cpFloat dt) {
+   // Same sequence as cpSpaceStep, see cpSpace.c
+   if (dt == 0)
+      return;
+
+   space->stamp++;
+
+   cpFloat prevDt = space->curr_dt;
+   space->curr_dt = dt;
+
+   cpArray* bodies = space->dynamicBodies;
+   cpArray* constraints = space->constraints;
+   cpArray* arbiters = space->arbiters;
+
+   // Reset and empty the arbiter list
+   for (int i = 0; i < arbiters->num; i++) {
+      cpArbiter* arb = (cpArbiter*) arbiters->arr[i];
+      arb->state = CP_ARBITER_STATE_NORMAL;
+      if (!cpBodyIsSleeping(arb->body_a) && !cpBodyIsSleeping(arb->body_b))
+         cpArbiterUnthread(arb);
+   }
+   arbiters->num = 0;
+
+   BodyLoop bodyLoop = {(cpBody**) bodies->arr, dt, cpfpow(space->damping, dt), space->gravity};
+   TraceClock::time_point start = TraceClock::now();
+
+   cpSpaceLock(space);
+   {
+      _pool.run(integratePositions, &bodyLoop, bodies->num, BODIES_GRAIN);
+      _phaseTimes[PHASE_INTEGRATE_POSITIONS] = lap(&start, STEP_PHASE_NAMES[PHASE_INTEGRATE_POSITIONS]);
+
+      // Find the colliding pairs, the time spent colliding them is taken
+      // out of the broadphase
+      cpSpacePushFreshContactBuffer(space);
+      cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc) cpShapeUpdateFunc, NULL);
+      _batch.space = space;
+      _batch.seconds = 0;
+      cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc) collideBatched, &_batch);
+      flushBatch(&_batch);
+      _phaseTimes[PHASE_NARROWPHASE] = _batch.seconds;
+      // The narrowphase batches are traced inside the broadphase
+      _phaseTimes[PHASE_BROADPHASE] = lap(&start, STEP_PHASE_NAMES[PHASE_BROADPHASE]) - _batch.seconds;
+   }
+   cpSpaceUnlock(space, cpFalse);
+
+   // Rebuild the contact graph, and put idle components to sleep
+   cpSpaceProcessComponents(space, dt);
+
+   cpSpaceLock(space);
+   {
+      // Clear out the old cached arbiters and call the separate callbacks
+      cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc) cpSpaceArbiterSetFilter, space);
+      _phaseTimes[PHASE_COMPONENTS] = lap(&start, STEP_PHASE_NAMES[PHASE_COMPONENTS]);
+
+      // Pre-step of the arbiters, each one only writes to itself
+      ArbiterLoop arbiterLoop = {(cpArbiter**) arbiters->arr, dt, space->collisionSlop,
+                                 1 - cpfpow(space->collisionBias, dt), prevDt == 0 ? 0 : dt / prevDt};
+      _pool.run(preStepArbiters, &arbiterLoop, arbiters->num, ARBITERS_GRAIN);
+
+      for (int i = 0; i < constraints->num; i++) {
+         cpConstraint* constraint = (cpConstraint*) constraints->arr[i];
+         if (constraint->preSolve)
+            constraint->preSolve(constraint, space);
+         constraint->klass->preStep(constraint, dt);
+      }
+      _phaseTimes[PHASE_PRESTEP] = lap(&start, STEP_PHASE_NAMES[PHASE_PRESTEP]);
+
+      _pool.run(integrateVelocities, &bodyLoop, bodies->num, BODIES_GRAIN);
+      _phaseTimes[PHASE_INTEGRATE_VELOCITIES] = lap(&start, STEP_PHASE_NAMES[PHASE_INTEGRATE_VELOCITIES]);
+
+      // Impulses write to both bodies of the arbiters : from here on, the
+      // work is split so that no body is written by two threads at once
+      if (_mode == SOLVER_ISLANDS)
+         solveIslands(space, &arbiterLoop);
+      else
+         solveColors(space, &arbiterLoop);
+      _phaseTimes[PHASE_SOLVER] = lap(&start, STEP_PHASE_NAMES[PHASE_SOLVER]);
+
+      // Post-solve callbacks of the constraints and of the arbiters
+      for (int i = 0; i < constraints->num; i++) {
+         cpConstraint* constraint = (cpConstraint*) constraints->arr[i];
+         if (constraint->postSolve)
+            constraint->postSolve(constraint, space);
+      }
+      for (int i = 0; i < arbiters->num; i++) {
+         cpArbiter* arb = (cpArbiter*) arbiters->arr[i];
+         arb->handler->postSolveFunc(arb, space, arb->handler->userData);
+      }
+   }
+   cpSpaceUnlock(space, cpTrue);
+   _phaseTimes[PHASE_POST_STEP] = lap(&start, STEP_PHASE_NAMES[PHASE_POST_STEP]);
+}
+
+void ThreadedStep::solveColors(cpSpace* space, ArbiterLoop* loop) {
+   cpArray* constraints = space->constraints;
+   colorArbiters(space->arbiters);
+
+   // Colors one after the other, then the arbiters left without a color.
+   // An arbiter only takes a color once the lower ones are taken, the
+   // colors past the first empty one are empty too.
+   ArbiterLoop colorLoop = *loop;
+   for (int pass = 0; pass <= space->iterations; pass++) {
+      ThreadPool::Task task = pass == 0 ? applyCachedImpulses : (_simd ? applyImpulsesSimd : applyImpulses);
+      for (int i = 0; i < MAX_COLORS && _colorStarts[i + 1] > _colorStarts[i]; i++) {
+         unsigned count = _colorStarts[i + 1] - _colorStarts[i];
+         colorLoop.arbiters = _ordered.data() + _colorStarts[i];
+         if (count < COLOR_PARALLEL_MIN)
+            task(&colorLoop, 0, count);
+         else
+            _pool.run(task, &colorLoop, count, ARBITERS_GRAIN);
+      }
+
+      // The arbiters of the last group may share bodies, they are solved one
+      // by one
+      task = pass == 0 ? applyCachedImpulses : applyImpulses;
+      colorLoop.arbiters = _ordered.data() + _colorStarts[MAX_COLORS];
+      task(&colorLoop, 0, _colorStarts[MAX_COLORS + 1] - _colorStarts[MAX_COLORS]);
+
+      for (int i = 0; i < constraints->num; i++) {
+         cpConstraint* constraint = (cpConstraint*) constraints->arr[i];
+         if (pass == 0)
+            constraint->klass->applyCachedImpulse(constraint, loop->dtCoef);
+         else
+            constraint->klass->applyImpulse(constraint, loop->dt);
+      }
+   }
+}
+
+void ThreadedStep::solveIslands(cpSpace* space, ArbiterLoop* loop) {
+   buildIslands(space->arbiters, space->constraints);
+
+   unsigned islands = _islandStarts.size() - 2;
+   IslandLoop islandLoop = {_ordered.data(), _islandStarts.data(),
+                            _orderedConstraints.data(), _islandConstraintStarts.data(),
+                            loop->dt, loop->dtCoef, space->iterations};
+   _pool.runStealing(solveIsland, &islandLoop, islands);
+
+   // Constraints between static or kinematic bodies only, in the last group
+   solveIsland(&islandLoop, islands, islands + 1);
+}
+
+void ThreadedStep::colorArbiters(cpArray* arbiters) {
+   unsigned count = arbiters->num;
+   resetBodies(count * 2);
+   _bodyColors.assign(count * 2, 0);
+   _groups.resize(count);
+
+   // Greedy coloring : each arbiter takes the first color that none of the
+   // arbiters of its bodies has. Static and kinematic bodies have an infinite
+   // mass, impulses leave them unchanged and they do not constrain the colors.
+   unsigned colorCounts[MAX_COLORS + 1] = {};
+   for (unsigned i = 0; i < count; i++) {
+      cpArbiter* arb = (cpArbiter*) arbiters->arr[i];
+      int idA = getBodyId(arb->body_a), idB = getBodyId(arb->body_b);
+      uint64_t colorsA = idA >= 0 ? _bodyColors[idA] : 0;
+      uint64_t colorsB = idB >= 0 ? _bodyColors[idB] : 0;
+
+      int color = firstFreeColor(colorsA | colorsB);
+      if (color < MAX_COLORS) {
+         if (idA >= 0)
+            _bodyColors[idA] |= (uint64_t) 1 << color;
+         if (idB >= 0)
+            _bodyColors[idB] |= (uint64_t) 1 << color;
+      }
+      _groups[i] = color;
+      ++ colorCounts[color];
+   }
+
+   // Arbiters sorted by color, keeping their order within a color
+   _colorStarts[0] = 0;
+   for (int i = 0; i <= MAX_COLORS; i++)
+      _colorStarts[i + 1] = _colorStarts[i] + colorCounts[i];
+
+   unsigned next[MAX_COLORS + 1];
+   memcpy(next, _colorStarts, sizeof(next));
+   _ordered.resize(count);
+   for (unsigned i = 0; i < count; i++)
+      _ordered[next[_groups[i]]++] = (cpArbiter*) arbiters->arr[i];
+}
+
+void ThreadedStep::buildIslands(cpArray* arbiters, cpArray* constraints) {
+   unsigned arbiterCount = arbiters->num, constraintCount = constraints->num;
+   resetBodies((arbiterCount + constraintCount) * 2);
+   _bodyParents.resize((arbiterCount + constraintCount) * 2);
+
+   // Union of the dynamic bodies of each arbiter and each constraint, static
+   // and kinematic bodies do not link islands
+   for (unsigned i = 0; i < arbiterCount + constraintCount; i++) {
+      cpBody *a, *b;
+      getLinkedBodies(arbiters, constraints, i, &a, &b);
+      int idA = getBodyId(a), idB = getBodyId(b);
+      if (idA >= 0 && idB >= 0) {
+         unsigned rootA = findIsland(idA), rootB = findIsland(idB);
+         _bodyParents[rootA > rootB ? rootA : rootB] = rootA < rootB ? rootA : rootB;
+      }
+   }
+
+   // Islands numbered by their root, in the order they first appear
+   _islandOfRoot.assign(_bodyCount, NO_GROUP);
+   _groups.resize(arbiterCount);
+   _constraintGroups.resize(constraintCount);
+   unsigned islands = 0;
+   for (unsigned i = 0; i < arbiterCount + constraintCount; i++) {
+      cpBody *a, *b;
+      getLinkedBodies(arbiters, constraints, i, &a, &b);
+      int id = getBodyId(a) >= 0 ? getBodyId(a) : getBodyId(b);
+      unsigned island = NO_GROUP;
+      if (id >= 0) {
+         unsigned root = findIsland(id);
+         if (_islandOfRoot[root] == NO_GROUP)
+            _islandOfRoot[root] = islands++;
+         island = _islandOfRoot[root];
+      }
+      if (i < arbiterCount)
+         _groups[i] = island;
+      else
+         _constraintGroups[i - arbiterCount] = island;
+   }
+
+   // Arbiters and constraints sorted by island, keeping their order. The
+   // last group, after the islands, gathers the ones moving no dynamic body.
+   _islandStarts.assign(islands + 2, 0);
+   _islandConstraintStarts.assign(islands + 2, 0);
+   for (unsigned i = 0; i < arbiterCount; i++) {
+      if (_groups[i] > islands)
+         _groups[i] = islands;
+      ++ _islandStarts[_groups[i] + 1];
+   }
+   for (unsigned i = 0; i < constraintCount; i++) {
+      if (_constraintGroups[i] > islands)
+         _constraintGroups[i] = islands;
+      ++ _islandConstraintStarts[_constraintGroups[i] + 1];
+   }
+   for (unsigned i = 0; i <= islands; i++) {
+      _islandStarts[i + 1] += _islandStarts[i];
+      _islandConstraintStarts[i + 1] += _islandConstraintStarts[i];
+   }
+
+   _next.assign(_islandStarts.begin(), _islandStarts.end() - 1);
+   _ordered.resize(arbiterCount);
+   for (unsigned i = 0; i < arbiterCount; i++)
+      _ordered[_next[_groups[i]]++] = (cpArbiter*) arbiters->arr[i];
+
+   _next.assign(_islandConstraintStarts.begin(), _islandConstraintStarts.end() - 1);
+   _orderedConstraints.resize(constraintCount);
+   for (unsigned i = 0; i < constraintCount; i++)
+      _orderedConstraints[_next[_constraintGroups[i]]++] = (cpConstraint*) constraints->arr[i];
+}
+
+void ThreadedStep::resetBodies(unsigned maxBodies) {
+   // Table of at least twice as many entries as there can be bodies
+   unsigned size = 16;
+   while (size < maxBodies * 2)
+      size *= 2;
+   _bodySlots.assign(size, {NULL, 0});
+   _bodyCount = 0;
+}
+
+int ThreadedStep::getBodyId(cpBody* body) {
+   if (cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC)
+      return -1;
+
+   unsigned mask = _bodySlots.size() - 1;
+   unsigned slot = (unsigned) (((uintptr_t) body >> 4) * 0x9E3779B1u) & mask;
+   while (_bodySlots[slot].body != body) {
+      if (_bodySlots[slot].body == NULL) {
+         _bodySlots[slot].body = body;
+         _bodySlots[slot].id = _bodyCount++;
+         if (_mode == SOLVER_ISLANDS)
+            _bodyParents[_bodySlots[slot].id] = _bodySlots[slot].id;
+         break;
+      }
+      slot = (slot + 1) & mask;
+   }
+   return _bodySlots[slot].id;
+}
+
+unsigned ThreadedStep::findIsland(unsigned id) {
+   while (_bodyParents[id] != id) {
+      // Path halving
+      _bodyParents[id] = _bodyParents[_bodyParents[id]];
+      id = _bodyParents[id];
+   }
+   return id;
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "chipmunk/chipmunk.h"
+#include "ThreadPool.h"
+#include "CircleSimd.h"
+
+// How the contacts are split between the threads
+enum SolverMode {
+   SOLVER_COLORS,   // groups of arbiters sharing no body, one after the other
+   SOLVER_ISLANDS,  // independent contact graphs, each on a single thread
+   NB_SOLVER_MODES
+};
+
+const char* getSolverModeName(SolverMode mode);
+
+// Phases of a step, in their order, timed by ThreadedStep
+enum StepPhase {
+   PHASE_INTEGRATE_POSITIONS,
+   PHASE_BROADPHASE,          // bounding boxes, update and query of the index
+   PHASE_NARROWPHASE,         // collision tests and arbiters of the pairs
+   PHASE_COMPONENTS,          // contact graph, sleep and cached arbiters
+   PHASE_PRESTEP,             // arbiters and constraints
+   PHASE_INTEGRATE_VELOCITIES,
+   PHASE_SOLVER,              // cached impulses and iterations
+   PHASE_POST_STEP,           // post-solve and post-step callbacks
+   NB_STEP_PHASES
+};
+
+const char* getStepPhaseName(StepPhase phase);
+
+/**
+ * @brief Reads a solver mode from its name
+ *
+ * @return false <name> is not a solver mode name
+ */
+bool parseSolverMode(const char* name, SolverMode* mode);
+
+// Parameters of the parallel loops over the arbiters of a step
+typedef struct arbiter_loop_t {
+   cpArbiter** arbiters;
+   cpFloat dt, slop, biasCoef, dtCoef;
+} ArbiterLoop;
+
+// Candidate pairs of circles waiting for their collision test
+typedef struct narrowphase_batch_t {
+   cpSpace* space;
+   std::vector<CirclePair> pairs;
+   std::vector<uint8_t> overlaps;
+   // Whether the pairs which do not overlap are dropped with SIMD first
+   bool simd;
+   // Time spent colliding the pairs since the start of the step, seconds
+   double seconds;
+} NarrowphaseBatch;
+
+/**
+ * @brief Multi-threaded replacement for cpSpaceStep, built like the step of
+ * cpHastySpace but not limited to two threads. The integration of the
+ * bodies and the pre-step of the arbiters run in parallel. Collision
+ * detection and callbacks stay on the calling thread. The impulses are
+ * solved either :
+ * - by colors : the arbiters are split into colors sharing no dynamic body,
+ *   so that each color can be solved in parallel without races, one color
+ *   after the other.
+ * - by islands : the bodies linked by arbiters or constraints are grouped
+ *   into islands, which are independent and solved as a whole by a single
+ *   thread, on a work-stealing pool. Each island is solved in the order of
+ *   cpSpaceStep, the results do not depend on the number of threads.
+ *
+ * The pairs of circles given by the broadphase are batched before going
+ * through cpSpaceCollideShapes in the same order, so that the narrowphase
+ * is timed apart from the broadphase. With SIMD enabled, the pairs which do
+ * not overlap are dropped from the batches with vector instructions, and
+ * the colors solver applies the impulses of the single contact arbiters
+ * SIMD_WIDTH at a time.
+ *
+ * Every phase of the step is timed, see getPhaseTimes.
+ */
+class ThreadedStep {
+   public:
+      // Number of colors, arbiters which do not fit are solved serially
+      static const int MAX_COLORS = 64;
+
+      /**
+       * @param threads number of threads of the step, caller included
+       */
+      ThreadedStep(unsigned threads, SolverMode mode, bool simd);
+
+      // Steps <space> by <dt>, same effect as cpSpaceStep
+      void step(cpSpace* space, cpFloat dt);
+
+      unsigned getThreadCount() const { return _pool.getThreadCount(); }
+      SolverMode getMode() const { return _mode; }
+      bool usesSimd() const { return _simd; }
+
+      // Seconds spent in each StepPhase during the last step
+      const double* getPhaseTimes() const { return _phaseTimes; }
+
+   private:
+      // Solves the arbiters and constraints of the step color by color
+      void solveColors(cpSpace* space, ArbiterLoop* loop);
+      // Solves the islands of the step on the work-stealing pool
+      void solveIslands(cpSpace* space, ArbiterLoop* loop);
+
+      /**
+       * @brief Sorts the arbiters of the step by color into <_ordered>, and
+       * fills <_colorStarts>
+       */
+      void colorArbiters(cpArray* arbiters);
+      /**
+       * @brief Sorts the arbiters and the constraints of the step by island
+       * into <_ordered> and <_orderedConstraints>, and fills the starts of
+       * the islands
+       */
+      void buildIslands(cpArray* arbiters, cpArray* constraints);
+
+      // Forgets the ids of the bodies, for up to <maxBodies> new ones
+      void resetBodies(unsigned maxBodies);
+      // Id of <body> for this step, -1 if it is not a dynamic body
+      int getBodyId(cpBody* body);
+      // Root of the island of the body <id>, union-find
+      unsigned findIsland(unsigned id);
+
+      // Entry of the body -> id table, open addressing
+      typedef struct body_slot_t {
+         cpBody* body;
+         unsigned id;
+      } BodySlot;
+
+      ThreadPool _pool;
+      const SolverMode _mode;
+      const bool _simd;
+      NarrowphaseBatch _batch;
+      double _phaseTimes[NB_STEP_PHASES];
+
+      std::vector<BodySlot> _bodySlots;
+      unsigned _bodyCount;
+      // Colors used by the arbiters of each body, parent of each body
+      std::vector<uint64_t> _bodyColors;
+      std::vector<unsigned> _bodyParents;
+
+      // Color or island of each arbiter, island of each constraint
+      std::vector<unsigned> _groups, _constraintGroups;
+      std::vector<unsigned> _islandOfRoot;
+      // Next free place of each group while sorting
+      std::vector<unsigned> _next;
+      std::vector<cpArbiter*> _ordered;
+      std::vector<cpConstraint*> _orderedConstraints;
+      // Start of each color in <_ordered>, the last color is the serial one
+      unsigned _colorStarts[MAX_COLORS + 2];
+      // Start of each island in <_ordered> and <_orderedConstraints>
+      std::vector<unsigned> _islandStarts, _islandConstraintStarts;
+};
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Trace.h"
+
+typedef struct trace_event_t {
+   const char* name;
+   int64_t start, end;  // nanoseconds since the start of the trace
+   unsigned thread;
+   // Number of the event plus one once written, 0 while it is being written
+   std::atomic<uint64_t> sequence;
+} TraceEvent;
+
+// Ring buffer of the events, and names of the traced threads
+typedef struct tracer_t {
+   std::atomic<bool> enabled;
+   // Allocated once by startTracing, kept until the process ends
+   TraceEvent* events;
+   unsigned capacity;
+   // Number of events recorded since the start
+   std::atomic<uint64_t> next;
+   TraceClock::time_point start;
+   std::atomic<unsigned> threadCount;
+   std::mutex threadNamesMutex;
+   std::vector<std::string> threadNames;
+} Tracer;
+
+Tracer globalTracer;
+
+// Number of the calling thread in the trace, 0 until it is given one
+thread_local unsigned traceThread = 0;
+
+// Functions declarations =====================================================
+
+// Number of the calling thread in the trace, given on its first event
+unsigned getTraceThread();
+
+// Nanoseconds between the start of the trace and <time>
+int64_t getTraceTime(TraceClock::time_point time);
+
+// Functions definitions ======================================================
+
+unsigned getTraceThread() {
+   if (traceThread == 0)
+      traceThread = ++ globalTracer.threadCount;
+   return traceThread;
+}
+
+int64_t getTraceTime(TraceClock::time_point time) {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(time - globalTracer.start).count();
+}
+
+void startTracing(unsigned capacity) {
+   if (globalTracer.enabled || capacity == 0)
+      return;
+   globalTracer.events = new TraceEvent[capacity];
+   globalTracer.capacity = capacity;
+   for (unsigned i = 0; i < capacity; i++)
+      globalTracer.events[i].sequence = 0;
+   globalTracer.start = TraceClock::now();
+   globalTracer.enabled = true;
+}
+
+bool isTracing() {
+   return globalTracer.enabled.load(std::memory_order_relaxed);
+}
+
+void setTraceThreadName(const char* name) {
+   unsigned thread = getTraceThread();
+   std::lock_guard<std::mutex> lock(globalTracer.threadNamesMutex);
+   if (globalTracer.threadNames.size() <= thread)
+      globalTracer.threadNames.resize(thread + 1);
+   globalTracer.threadNames[thread] = name;
+}
+
+void traceEvent(const char* name, TraceClock::time_point start, TraceClock::time_point end) {
+   if (!isTracing())
+      return;
+
+   // The event is marked as being written while its fields change, so that
+   // saveTrace can tell a torn event
+   uint64_t number = globalTracer.next.fetch_add(1, std::memory_order_relaxed);
+   TraceEvent& event = globalTracer.events[number % globalTracer.capacity];
+   event.sequence.store(0, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   event.name = name;
+   event.start = getTraceTime(start);
+   event.end = getTraceTime(end);
+   event.thread = getTraceThread();
+   event.sequence.store(number + 1, std::memory_order_release);
+}
+
+bool saveTrace(const char* path) {
+   if (!isTracing())
+      return false;
+   FILE* file = fopen(path, "w");
+   if (!file) {
+      fprintf(stderr, "Could not open %s for writing\n", path);
+      return false;
+   }
+
+   fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+   {
+      std::lock_guard<std::mutex> lock(globalTracer.threadNamesMutex);
+      for (unsigned i = 0; i < globalTracer.threadNames.size(); i++) {
+         if (!globalTracer.threadNames[i].empty())
+            fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}},\n",
+                    i, globalTracer.threadNames[i].c_str());
+      }
+   }
+
+   // Events still in the buffer, from the oldest one, as complete events
+   // with their times in microseconds
+   uint64_t end = globalTracer.next.load(std::memory_order_acquire);
+   uint64_t begin = end > globalTracer.capacity ? end - globalTracer.capacity : 0;
+   unsigned saved = 0;
+   for (uint64_t number = begin; number < end; number++) {
+      TraceEvent& event = globalTracer.events[number % globalTracer.capacity];
+      if (event.sequence.load(std::memory_order_acquire) != number + 1)
+         continue;
+      TraceEvent copy;
+      copy.name = event.name;
+      copy.start = event.start;
+      copy.end = event.end;
+      copy.thread = event.thread;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (event.sequence.load(std::memory_order_relaxed) != number + 1)
+         continue;
+
+      fprintf(file, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f},\n",
+              copy.name, copy.thread, copy.start / 1000.0, (copy.end - copy.start) / 1000.0);
+      ++ saved;
+   }
+   // The last element closes the list, JSON allows no trailing comma
+   fprintf(file, "{\"name\": \"trace saved\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f}\n]}\n",
+           getTraceThread(), getTraceTime(TraceClock::now()) / 1000.0);
+
+   if (fclose(file) != 0) {
+      fprintf(stderr, "Could not write %s\n", path);
+      return false;
+   }
+   fprintf(stderr, "%u trace events written into %s\n", saved, path);
+   return true;
+}
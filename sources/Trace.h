@@ -0,0 +1,67 @@
+#pragma once
+#include <chrono>
+
+/*
+ * Opt-in tracing of what the threads are doing, for timeline viewers. Each
+ * event is a named span of time on a thread, stored into a ring buffer
+ * shared by every thread : recording an event takes an atomic increment and
+ * a few stores, and the oldest events are overwritten once the buffer is
+ * full. The buffer is written as Chrome trace-event JSON, which can be
+ * opened in chrome://tracing or https://ui.perfetto.dev.
+ */
+
+typedef std::chrono::steady_clock TraceClock;
+
+/**
+ * @brief Starts recording the events into a ring buffer of <capacity>
+ * events. Must be called once, before the traced threads are started.
+ * Until then, tracing costs a test per event.
+ */
+void startTracing(unsigned capacity);
+
+bool isTracing();
+
+/**
+ * @brief Names the calling thread in the trace, events of unnamed threads
+ * are shown under a number
+ */
+void setTraceThreadName(const char* name);
+
+/**
+ * @brief Records the span [start, end] on the calling thread
+ *
+ * @param name must stay valid until the trace is saved, string literals
+ * are expected
+ */
+void traceEvent(const char* name, TraceClock::time_point start, TraceClock::time_point end);
+
+/**
+ * @brief Writes the events in the buffer as Chrome trace-event JSON. Can be
+ * called while events are being recorded, the ones being written at the
+ * same time are left out.
+ *
+ * @return false tracing is not started or the file could not be written
+ */
+bool saveTrace(const char* path);
+
+/**
+ * @brief Records the span of its own lifetime, from its construction to
+ * the end of its scope
+ */
+class TraceScope {
+   public:
+      explicit TraceScope(const char* name): _name(isTracing() ? name : NULL) {
+         if (_name)
+            _start = TraceClock::now();
+      }
+      ~TraceScope() {
+         if (_name)
+            traceEvent(_name, _start, TraceClock::now());
+      }
+      TraceScope(const TraceScope&) = delete;
+      TraceScope& operator=(const TraceScope&) = delete;
+
+   private:
+      const char* _name;
+      TraceClock::time_point _start;
+};
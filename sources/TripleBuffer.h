@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+
+/**
+ * @brief Lock-free triple buffer between one writer thread and one reader
+ * thread. The writer fills the back buffer and publishes it, the reader
+ * picks the most recently published buffer up. Neither of them ever waits
+ * for the other, the reader simply skips the states it was too slow to see.
+ *
+ * @tparam T type of the buffered state
+ */
+template <typename T>
+class TripleBuffer {
+   public:
+      TripleBuffer(): _middle(pack(1, false)), _back(0), _front(2) {}
+
+      // Writer side ----------------------------------------------------------
+
+      // Buffer the writer is free to fill
+      T& getBackBuffer() { return _buffers[_back]; }
+
+      // Hands the back buffer over to the reader
+      void publish() {
+         int previous = _middle.exchange(pack(_back, true), std::memory_order_acq_rel);
+         _back = index(previous);
+      }
+
+      // Reader side ----------------------------------------------------------
+
+      /**
+       * @brief Fetches the last published buffer, if any
+       *
+       * @return true the front buffer changed
+       * @return false nothing new was published since the last call
+       */
+      bool update() {
+         if (!fresh(_middle.load(std::memory_order_acquire)))
+            return false;
+         int previous = _middle.exchange(pack(_front, false), std::memory_order_acq_rel);
+         _front = index(previous);
+         return true;
+      }
+
+      // Buffer the reader is free to read
+      const T& getFrontBuffer() const { return _buffers[_front]; }
+
+   private:
+      static int pack(int index, bool fresh) { return index | (fresh ? 4 : 0); }
+      static int index(int packed) { return packed & 3; }
+      static bool fresh(int packed) { return packed & 4; }
+
+      T _buffers[3];
+      // Index of the buffer in between, with a "fresh" bit set when the
+      // writer published it and the reader did not pick it up yet
+      std::atomic<int> _middle;
+      int _back;
+      int _front;
+};
@@ -0,0 +1,353 @@
+#include <new>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include "UniformGrid.h"
+// The private header does not declare its functions as C ones
+extern "C" {
+#include "chipmunk/chipmunk_private.h"
+}
+
+// Maximum number of columns or rows, bounds the memory of a grid over a
+// huge area with tiny cells
+const int MAX_GRID_SIDE = 4096;
+
+// Cell of the objects kept aside
+const int NO_CELL = -1;
+
+// Object and bounding box, as stored in the cells
+typedef struct grid_entry_t {
+   cpBB bb;
+   void* object;
+} GridEntry;
+
+// The index itself, <spatialIndex> must come first for chipmunk to use it
+typedef struct uniform_grid_t {
+   cpSpatialIndex spatialIndex;
+
+   cpBB bounds;
+   cpFloat cellSize, inverseCellSize;
+   int columns, rows;
+
+   // Objects in insertion order, with their hash, box and cell, and where
+   // they are in <sorted> or <large>
+   std::vector<void*> objects;
+   std::vector<cpHashValue> hashids;
+   std::vector<cpBB> bbs;
+   std::vector<int> cells;
+   std::vector<unsigned> places;
+   std::unordered_map<cpHashValue, unsigned> indices;
+
+   // Objects sorted by cell, the ones of cell c are in
+   // [cellStarts[c], cellStarts[c+1])
+   std::vector<unsigned> cellStarts;
+   std::vector<GridEntry> sorted;
+   // Objects wider than a cell
+   std::vector<GridEntry> large;
+   // Whether <sorted> and <large> must be built again
+   bool dirty;
+} UniformGrid;
+
+// Functions declarations =====================================================
+
+// Column and row of a coordinate, clamped to the grid
+int getColumn(const UniformGrid* grid, cpFloat x);
+int getRow(const UniformGrid* grid, cpFloat y);
+
+// Cell of an object with the box <bb>, NO_CELL if it is wider than a cell
+int getCell(const UniformGrid* grid, cpBB bb);
+
+// Sorts the objects by cell, if they changed since the last time
+void sortObjects(UniformGrid* grid);
+
+/**
+ * @brief Calls <func> for <object> and each object of the cells around
+ * <bb> whose box overlaps <bb>. The cells are extended by one in every
+ * direction since the objects may overflow their cell by half of it.
+ */
+void queryCells(const UniformGrid* grid, void* object, cpBB bb, cpSpatialIndexQueryFunc func, void* data);
+
+// cpSpatialIndexClass implementation
+void gridDestroy(UniformGrid* grid);
+int gridCount(UniformGrid* grid);
+void gridEach(UniformGrid* grid, cpSpatialIndexIteratorFunc func, void* data);
+cpBool gridContains(UniformGrid* grid, void* object, cpHashValue hashid);
+void gridInsert(UniformGrid* grid, void* object, cpHashValue hashid);
+void gridRemove(UniformGrid* grid, void* object, cpHashValue hashid);
+void gridReindex(UniformGrid* grid);
+void gridReindexObject(UniformGrid* grid, void* object, cpHashValue hashid);
+void gridReindexQuery(UniformGrid* grid, cpSpatialIndexQueryFunc func, void* data);
+void gridQuery(UniformGrid* grid, void* object, cpBB bb, cpSpatialIndexQueryFunc func, void* data);
+void gridSegmentQuery(UniformGrid* grid, void* object, cpVect a, cpVect b, cpFloat tExit, cpSpatialIndexSegmentQueryFunc func, void* data);
+
+cpSpatialIndexClass UNIFORM_GRID_CLASS = {
+   (cpSpatialIndexDestroyImpl) gridDestroy,
+   (cpSpatialIndexCountImpl) gridCount,
+   (cpSpatialIndexEachImpl) gridEach,
+   (cpSpatialIndexContainsImpl) gridContains,
+   (cpSpatialIndexInsertImpl) gridInsert,
+   (cpSpatialIndexRemoveImpl) gridRemove,
+   (cpSpatialIndexReindexImpl) gridReindex,
+   (cpSpatialIndexReindexObjectImpl) gridReindexObject,
+   (cpSpatialIndexReindexQueryImpl) gridReindexQuery,
+   (cpSpatialIndexQueryImpl) gridQuery,
+   (cpSpatialIndexSegmentQueryImpl) gridSegmentQuery,
+};
+
+// Functions definitions ======================================================
+
+cpSpatialIndex* uniformGridNew(cpBB bounds, cpFloat cellSize, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex* staticIndex) {
+   // Freed by cpSpatialIndexFree with cpfree, after gridDestroy
+   UniformGrid* grid = new (cpcalloc(1, sizeof(UniformGrid))) UniformGrid();
+   cpSpatialIndexInit(&grid->spatialIndex, &UNIFORM_GRID_CLASS, bbfunc, staticIndex);
+
+   cpFloat width = cpfmax(bounds.r - bounds.l, 1);
+   cpFloat height = cpfmax(bounds.t - bounds.b, 1);
+   // A bit larger than asked : the box of a ball of the asked diameter can
+   // be wider by a rounding error, and would not fit in a cell
+   cellSize = cpfmax(cellSize * (1 + 1e-6), cpfmax(width, height) / MAX_GRID_SIDE);
+   grid->bounds = bounds;
+   grid->cellSize = cellSize;
+   grid->inverseCellSize = 1 / cellSize;
+   grid->columns = (int) cpfceil(width / cellSize);
+   grid->rows = (int) cpfceil(height / cellSize);
+   grid->cellStarts.assign(grid->columns * grid->rows + 1, 0);
+   grid->dirty = true;
+   return &grid->spatialIndex;
+}
+
+int getColumn(const UniformGrid* grid, cpFloat x) {
+   cpFloat column = cpffloor((x - grid->bounds.l) * grid->inverseCellSize);
+   // Written so that NaN ends in the first column
+   if (!(column >= 0))
+      return 0;
+   return column < grid->columns ? (int) column : grid->columns - 1;
+}
+
+int getRow(const UniformGrid* grid, cpFloat y) {
+   cpFloat row = cpffloor((y - grid->bounds.b) * grid->inverseCellSize);
+   if (!(row >= 0))
+      return 0;
+   return row < grid->rows ? (int) row : grid->rows - 1;
+}
+
+int getCell(const UniformGrid* grid, cpBB bb) {
+   if (bb.r - bb.l > grid->cellSize || bb.t - bb.b > grid->cellSize)
+      return NO_CELL;
+   return getRow(grid, (bb.b + bb.t) / 2) * grid->columns + getColumn(grid, (bb.l + bb.r) / 2);
+}
+
+void sortObjects(UniformGrid* grid) {
+   if (!grid->dirty)
+      return;
+   grid->dirty = false;
+
+   // Counting sort of the objects by cell, the counts of cell c are first
+   // put in cellStarts[c+1] so that the prefix sum gives the starts
+   std::vector<unsigned>& starts = grid->cellStarts;
+   std::fill(starts.begin(), starts.end(), 0);
+   grid->large.clear();
+   for (unsigned i = 0; i < grid->objects.size(); i++) {
+      if (grid->cells[i] == NO_CELL) {
+         grid->places[i] = grid->large.size();
+         grid->large.push_back({grid->bbs[i], grid->objects[i]});
+      } else
+         ++ starts[grid->cells[i] + 1];
+   }
+   for (unsigned c = 1; c < starts.size(); c++)
+      starts[c] += starts[c - 1];
+
+   // Each object is put at the start of its cell, which moves the start to
+   // the next place. The starts are then one cell late and shifted back.
+   grid->sorted.resize(grid->objects.size() - grid->large.size());
+   for (unsigned i = 0; i < grid->objects.size(); i++) {
+      int cell = grid->cells[i];
+      if (cell == NO_CELL)
+         continue;
+      unsigned place = starts[cell]++;
+      grid->places[i] = place;
+      grid->sorted[place] = {grid->bbs[i], grid->objects[i]};
+   }
+   for (unsigned c = starts.size() - 1; c > 0; c--)
+      starts[c] = starts[c - 1];
+   starts[0] = 0;
+}
+
+void queryCells(const UniformGrid* grid, void* object, cpBB bb, cpSpatialIndexQueryFunc func, void* data) {
+   int left = getColumn(grid, bb.l), right = getColumn(grid, bb.r);
+   int bottom = getRow(grid, bb.b), top = getRow(grid, bb.t);
+   left = left > 0 ? left - 1 : 0;
+   bottom = bottom > 0 ? bottom - 1 : 0;
+   right = right + 1 < grid->columns ? right + 1 : right;
+   top = top + 1 < grid->rows ? top + 1 : top;
+
+   for (int row = bottom; row <= top; row++) {
+      // The cells of a row are contiguous in <sorted>
+      unsigned begin = grid->cellStarts[row * grid->columns + left];
+      unsigned end = grid->cellStarts[row * grid->columns + right + 1];
+      for (unsigned i = begin; i < end; i++) {
+         if (cpBBIntersects(bb, grid->sorted[i].bb))
+            func(object, grid->sorted[i].object, 0, data);
+      }
+   }
+}
+
+void gridDestroy(UniformGrid* grid) {
+   grid->~UniformGrid();
+}
+
+int gridCount(UniformGrid* grid) {
+   return grid->objects.size();
+}
+
+void gridEach(UniformGrid* grid, cpSpatialIndexIteratorFunc func, void* data) {
+   for (unsigned i = 0; i < grid->objects.size(); i++)
+      func(grid->objects[i], data);
+}
+
+cpBool gridContains(UniformGrid* grid, void* object, cpHashValue hashid) {
+   return grid->indices.count(hashid) != 0;
+}
+
+void gridInsert(UniformGrid* grid, void* object, cpHashValue hashid) {
+   cpBB bb = grid->spatialIndex.bbfunc(object);
+   grid->indices[hashid] = grid->objects.size();
+   grid->objects.push_back(object);
+   grid->hashids.push_back(hashid);
+   grid->bbs.push_back(bb);
+   grid->cells.push_back(getCell(grid, bb));
+   grid->places.push_back(0);
+   grid->dirty = true;
+}
+
+void gridRemove(UniformGrid* grid, void* object, cpHashValue hashid) {
+   std::unordered_map<cpHashValue, unsigned>::iterator found = grid->indices.find(hashid);
+   if (found == grid->indices.end())
+      return;
+
+   // The last object takes the place of the removed one
+   unsigned index = found->second, last = grid->objects.size() - 1;
+   grid->indices.erase(found);
+   if (index != last) {
+      grid->objects[index] = grid->objects[last];
+      grid->hashids[index] = grid->hashids[last];
+      grid->bbs[index] = grid->bbs[last];
+      grid->cells[index] = grid->cells[last];
+      grid->indices[grid->hashids[index]] = index;
+   }
+   grid->objects.pop_back();
+   grid->hashids.pop_back();
+   grid->bbs.pop_back();
+   grid->cells.pop_back();
+   grid->places.pop_back();
+   grid->dirty = true;
+}
+
+void gridReindex(UniformGrid* grid) {
+   // The boxes of the objects which stay in their cell are updated in
+   // place, the objects are only sorted again if one of them moved
+   cpSpatialIndexBBFunc bbfunc = grid->spatialIndex.bbfunc;
+   for (unsigned i = 0; i < grid->objects.size(); i++) {
+      cpBB bb = bbfunc(grid->objects[i]);
+      int cell = getCell(grid, bb);
+      grid->bbs[i] = bb;
+      if (cell != grid->cells[i]) {
+         grid->cells[i] = cell;
+         grid->dirty = true;
+      } else if (!grid->dirty)
+         (cell == NO_CELL ? grid->large : grid->sorted)[grid->places[i]].bb = bb;
+   }
+   sortObjects(grid);
+}
+
+void gridReindexObject(UniformGrid* grid, void* object, cpHashValue hashid) {
+   std::unordered_map<cpHashValue, unsigned>::iterator found = grid->indices.find(hashid);
+   if (found == grid->indices.end())
+      return;
+
+   unsigned i = found->second;
+   cpBB bb = grid->spatialIndex.bbfunc(object);
+   int cell = getCell(grid, bb);
+   grid->bbs[i] = bb;
+   if (cell != grid->cells[i]) {
+      grid->cells[i] = cell;
+      grid->dirty = true;
+   } else if (!grid->dirty)
+      (cell == NO_CELL ? grid->large : grid->sorted)[grid->places[i]].bb = bb;
+}
+
+void gridReindexQuery(UniformGrid* grid, cpSpatialIndexQueryFunc func, void* data) {
+   gridReindex(grid);
+
+   // Each cell is paired with itself and with the cells on its right, below
+   // left, below and below right. The other half of the neighbors pair
+   // with it from their side.
+   const int columns = grid->columns, rows = grid->rows;
+   const std::vector<unsigned>& starts = grid->cellStarts;
+   const std::vector<GridEntry>& sorted = grid->sorted;
+   for (int row = 0; row < rows; row++) {
+      for (int column = 0; column < columns; column++) {
+         int cell = row * columns + column;
+         unsigned begin = starts[cell], end = starts[cell + 1];
+         if (begin == end)
+            continue;
+
+         // Neighbors taken as ranges of <sorted> : the right cell, then the
+         // three cells of the next row, which are contiguous
+         unsigned rangeBegins[2], rangeEnds[2];
+         int ranges = 0;
+         if (column + 1 < columns) {
+            rangeBegins[ranges] = starts[cell + 1];
+            rangeEnds[ranges++] = starts[cell + 2];
+         }
+         if (row + 1 < rows) {
+            int below = cell + columns;
+            rangeBegins[ranges] = starts[column > 0 ? below - 1 : below];
+            rangeEnds[ranges++] = starts[column + 1 < columns ? below + 2 : below + 1];
+         }
+
+         for (unsigned i = begin; i < end; i++) {
+            const GridEntry& entry = sorted[i];
+            for (unsigned j = i + 1; j < end; j++) {
+               if (cpBBIntersects(entry.bb, sorted[j].bb))
+                  func(entry.object, sorted[j].object, 0, data);
+            }
+            for (int r = 0; r < ranges; r++) {
+               for (unsigned j = rangeBegins[r]; j < rangeEnds[r]; j++) {
+                  if (cpBBIntersects(entry.bb, sorted[j].bb))
+                     func(entry.object, sorted[j].object, 0, data);
+               }
+            }
+         }
+      }
+   }
+
+   // Large objects against the cells they overlap and against each other
+   for (unsigned i = 0; i < grid->large.size(); i++) {
+      const GridEntry& entry = grid->large[i];
+      queryCells(grid, entry.object, entry.bb, func, data);
+      for (unsigned j = i + 1; j < grid->large.size(); j++) {
+         if (cpBBIntersects(entry.bb, grid->large[j].bb))
+            func(entry.object, grid->large[j].object, 0, data);
+      }
+   }
+
+   cpSpatialIndexCollideStatic(&grid->spatialIndex, grid->spatialIndex.staticIndex, func, data);
+}
+
+void gridQuery(UniformGrid* grid, void* object, cpBB bb, cpSpatialIndexQueryFunc func, void* data) {
+   sortObjects(grid);
+   queryCells(grid, object, bb, func, data);
+   for (unsigned i = 0; i < grid->large.size(); i++) {
+      if (cpBBIntersects(bb, grid->large[i].bb))
+         func(object, grid->large[i].object, 0, data);
+   }
+}
+
+void gridSegmentQuery(UniformGrid* grid, void* object, cpVect a, cpVect b, cpFloat tExit, cpSpatialIndexSegmentQueryFunc func, void* data) {
+   // Segment queries are rare in the game, every box is tested
+   for (unsigned i = 0; i < grid->objects.size(); i++) {
+      if (cpBBSegmentQuery(grid->bbs[i], a, b) < tExit)
+         tExit = cpfmin(tExit, func(object, grid->objects[i], data));
+   }
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "chipmunk/chipmunk.h"
+
+/**
+ * @brief Creates a spatial index made of a dense grid of square cells over
+ * <bounds>, for many objects of about the same size, such as a pile of
+ * balls of equal radius.
+ *
+ * Each object is stored in the cell of the center of its bounding box, the
+ * objects are sorted by cell with a counting sort, only redone when one of
+ * them changes cell. Pairs are found in the cell of each object and in half
+ * of its neighbors, so that each pair is visited once. Objects wider than a
+ * cell are kept aside and tested against the cells they overlap, objects
+ * outside <bounds> go in the border cells.
+ *
+ * @param cellSize side of the cells, the diameter of the balls
+ * @param staticIndex index of the static objects, as for cpSpaceHashNew
+ */
+cpSpatialIndex* uniformGridNew(cpBB bounds, cpFloat cellSize, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex* staticIndex);
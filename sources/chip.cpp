@@ -1,64 +1,348 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
 #include "chipmunk/chipmunk.h"
+#include "Simulation.h"
+#include "Trace.h"
 
-int main(void){
-  // cpVect is a 2D vector and cpv() is a shortcut for initializing them.
-  cpVect gravity = cpv(0, -100);
-  
-  // Create an empty space.
-  cpSpace *space = cpSpaceNew();
-  cpSpaceSetGravity(space, gravity);
-  
-  // Add a static line segment shape for the ground.
-  // We'll make it slightly tilted so the ball will roll off.
-  // We attach it to a static body to tell Chipmunk it shouldn't be movable.
-  cpShape *ground = cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(-20, 5), cpv(20, -5), 0);
-  cpShapeSetFriction(ground, 1);
-  cpSpaceAddShape(space, ground);
-  
-  // Now let's make a ball that falls onto the line and rolls off.
-  // First we need to make a cpBody to hold the physical properties of the object.
-  // These include the mass, position, velocity, angle, etc. of the object.
-  // Then we attach collision shapes to the cpBody to give it a size and shape.
-  
-  cpFloat radius = 5;
-  cpFloat mass = 1;
-  
-  // The moment of inertia is like mass for rotation
-  // Use the cpMomentFor*() functions to help you approximate it.
-  cpFloat moment = cpMomentForCircle(mass, 0, radius, cpvzero);
-  
-  // The cpSpaceAdd*() functions return the thing that you are adding.
-  // It's convenient to create and add an object in one line.
-  cpBody *ballBody = cpSpaceAddBody(space, cpBodyNew(mass, moment));
-  cpBodySetPosition(ballBody, cpv(0, 15));
-  
-  // Now we create the collision shape for the ball.
-  // You can create multiple collision shapes that point to the same body.
-  // They will all be attached to the body and move around to follow it.
-  cpShape *ballShape = cpSpaceAddShape(space, cpCircleShapeNew(ballBody, radius, cpvzero));
-  cpShapeSetFriction(ballShape, 0.7);
-  
-  // Now that it's all set up, we simulate all the objects in the space by
-  // stepping forward through time in small increments called steps.
-  // It is *highly* recommended to use a fixed size time step.
-  cpFloat timeStep = 1.0/60.0;
-  for(cpFloat time = 0; time < 2; time += timeStep){
-    cpVect pos = cpBodyGetPosition(ballBody);
-    cpVect vel = cpBodyGetVelocity(ballBody);
-    printf(
-      "Time is %5.2f. ballBody is at (%5.2f, %5.2f). It's velocity is (%5.2f, %5.2f)\n",
-      time, pos.x, pos.y, vel.x, vel.y
-    );
-    
-    cpSpaceStep(space, timeStep);
-  }
-  
-  // Clean up our objects and exit!
-  cpShapeFree(ballShape);
-  cpBodyFree(ballBody);
-  cpShapeFree(ground);
-  cpSpaceFree(space);
-  
-  return 0;
+// Headless benchmark of the ball scene of the game : same walls, balls and
+// gravity, stepped as fast as possible without SDL. Results are written to
+// the standard output as CSV or JSON, logs go to the standard error.
+
+// Constants ==================================================================
+
+const int SCREEN_WIDTH = 1920;
+const int SCREEN_HEIGHT = 1080;
+
+// Box area per ball when the box is scaled to the number of balls, a bit more
+// than twice the square around a ball of radius 30 so that they settle in a
+// few layers instead of a compact pile
+const int AREA_PER_BALL = 8000;
+
+const int DEFAULT_BALL_COUNTS[] = {1000, 5000, 20000, 100000};
+const int DEFAULT_FRAMES = 120;
+const int DEFAULT_WARMUP = 60;
+
+// Number of events kept by the trace
+const unsigned TRACE_CAPACITY = 1 << 20;
+
+// Types ======================================================================
+
+typedef struct bench_options_t {
+   std::vector<int> ballCounts;
+   int frames;
+   int warmup;
+   int width, height;  // 0 : scaled to the number of balls
+   bool json;
+   // Replayed instead of the spawn of the ball counts, NULL if none
+   const char* replayPath;
+   Recording replay;
+   // Snapshot written at the end of the warmup of each run, NULL if none
+   const char* savePath;
+   // Snapshot measured instead of the spawn of the ball counts, NULL if none
+   const char* loadPath;
+   // Trace of the runs written at the end, NULL if none
+   const char* tracePath;
+   SimulationSettings settings;
+} BenchOptions;
+
+// Measures of a run, durations in nanoseconds per step
+typedef struct bench_result_t {
+   int balls;
+   int finalBalls;
+   int awakeBalls;  // at the end of the run
+   int width, height;
+   int frames;
+   int threads;
+   SolverMode solver;
+   bool simd;
+   bool sleep;
+   bool substituteStep;    // stepped by the stand-in for cpSpaceStep to time its phases
+   Broadphase broadphase;  // in use at the end of the run
+   double total;
+   StepTimings phases;
+} BenchResult;
+
+// Functions declarations =====================================================
+
+/**
+ * @brief Parses the command line
+ *
+ * @return false the command line is invalid, the usage has been printed
+ */
+bool parseOptions(int argc, const char** argv, BenchOptions* options);
+
+/**
+ * @brief Spawns <balls> balls in the scene, lets them settle for the warmup
+ * frames, then measures the given number of frames
+ */
+BenchResult runBench(const BenchOptions& options, int balls);
+
+/**
+ * @brief Replays the recording of the options and measures every step of
+ * it, followed by the given number of frames
+ */
+BenchResult runReplay(const BenchOptions& options);
+
+/**
+ * @brief Restores the snapshot of the options and measures the given
+ * number of frames from there, without warmup
+ */
+BenchResult runSnapshot(const BenchOptions& options);
+
+/**
+ * @brief Steps <simulation> <frames> times and adds the durations to
+ * <result>, then fills the state of the simulation at the end
+ */
+void measure(Simulation* simulation, int frames, BenchResult* result);
+
+void printCsv(const std::vector<BenchResult>& results);
+void printJson(const std::vector<BenchResult>& results);
+
+// Main =======================================================================
+
+int main(int argc, const char** argv) {
+   BenchOptions options;
+   if (!parseOptions(argc, argv, &options))
+      return 1;
+
+   if (options.tracePath) {
+      startTracing(TRACE_CAPACITY);
+      setTraceThreadName("bench");
+   }
+
+   std::vector<BenchResult> results;
+   if (options.replayPath)
+      results.push_back(runReplay(options));
+   else if (options.loadPath)
+      results.push_back(runSnapshot(options));
+   else {
+      for (unsigned i = 0; i < options.ballCounts.size(); i++)
+         results.push_back(runBench(options, options.ballCounts[i]));
+   }
+
+   if (options.json)
+      printJson(results);
+   else
+      printCsv(results);
+
+   if (options.tracePath)
+      saveTrace(options.tracePath);
+
+   return 0;
+}
+
+// Functions definitions ======================================================
+
+bool parseOptions(int argc, const char** argv, BenchOptions* options) {
+   options->frames = DEFAULT_FRAMES;
+   options->warmup = DEFAULT_WARMUP;
+   options->width = 0;
+   options->height = 0;
+   options->json = false;
+   options->replayPath = NULL;
+   options->savePath = NULL;
+   options->loadPath = NULL;
+   options->tracePath = NULL;
+   options->settings.seed = 42;
+
+   for (int i = 1; i < argc; i++) {
+      bool hasValue = i + 1 < argc;
+      if (strcmp(argv[i], "--json") == 0)
+         options->json = true;
+      else if (strcmp(argv[i], "--csv") == 0)
+         options->json = false;
+      else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+         options->frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+         options->warmup = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--balls") == 0 && hasValue && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) <= MAX_SPAWN_COUNT)
+         options->ballCounts.push_back(atoi(argv[++i]));
+      else if (strcmp(argv[i], "--width") == 0 && hasValue)
+         options->width = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--height") == 0 && hasValue)
+         options->height = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+         options->replayPath = argv[++i];
+      else if (strcmp(argv[i], "--save-snapshot") == 0 && hasValue)
+         options->savePath = argv[++i];
+      else if (strcmp(argv[i], "--load-snapshot") == 0 && hasValue)
+         options->loadPath = argv[++i];
+      else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+         options->tracePath = argv[++i];
+      else if (!parseSimulationOption(argc, argv, &i, &options->settings)) {
+         fprintf(stderr,
+            "Usage: %s [--csv | --json] [--balls N]... [--frames N] [--warmup N]\n"
+            "          [--width W --height H] [--replay FILE] [--save-snapshot FILE | --load-snapshot FILE]\n"
+            "          [--trace FILE]\n"
+            "          %s\n", argv[0], SIMULATION_USAGE);
+         return false;
+      }
+   }
+
+   if (options->replayPath && !loadRecording(options->replayPath, &options->replay))
+      return false;
+   if (options->ballCounts.empty())
+      options->ballCounts.assign(DEFAULT_BALL_COUNTS,
+         DEFAULT_BALL_COUNTS + sizeof(DEFAULT_BALL_COUNTS) / sizeof(DEFAULT_BALL_COUNTS[0]));
+   if (options->frames < 1)
+      options->frames = 1;
+   return true;
+}
+
+BenchResult runBench(const BenchOptions& options, int balls) {
+   BenchResult result = {};
+   result.balls = balls;
+   result.frames = options.frames;
+   result.threads = options.settings.threads;
+   result.solver = options.settings.solver;
+   result.sleep = options.settings.sleep;
+
+   // Box of the screen proportions, grown until the balls fit in it
+   result.width = options.width;
+   result.height = options.height;
+   if (result.width <= 0 || result.height <= 0) {
+      double scale = sqrt((double) balls * AREA_PER_BALL / (SCREEN_WIDTH * SCREEN_HEIGHT));
+      if (scale < 1)
+         scale = 1;
+      result.width = (int) (SCREEN_WIDTH * scale);
+      result.height = (int) (SCREEN_HEIGHT * scale);
+   }
+
+   Simulation simulation(result.width, result.height, options.settings);
+   simulation.pushCommand({COMMAND_SPAWN, result.width / 2, result.height / 2, balls});
+
+   for (int i = 0; i < options.warmup; i++)
+      simulation.advance();
+   if (options.savePath)
+      simulation.saveSnapshot(options.savePath);
+   measure(&simulation, options.frames, &result);
+
+   fprintf(stderr, "%d balls, %s : %.0f ns/step\n", balls, getBroadphaseName(result.broadphase), result.total);
+   return result;
+}
+
+BenchResult runReplay(const BenchOptions& options) {
+   const Recording& recording = options.replay;
+   BenchResult result = {};
+   result.width = recording.width;
+   result.height = recording.height;
+   result.threads = options.settings.threads;
+   result.solver = options.settings.solver;
+   result.sleep = options.settings.sleep;
+   for (unsigned i = 0; i < recording.commands.size(); i++) {
+      if (recording.commands[i].command.type == COMMAND_SPAWN)
+         result.balls += recording.commands[i].command.count;
+   }
+
+   SimulationSettings settings = options.settings;
+   settings.seed = recording.seed;
+   settings.spawn = recording.spawn;
+   Simulation simulation(recording.width, recording.height, settings);
+   simulation.replay(recording);
+
+   unsigned long lastStep = recording.commands.empty() ? 0 : recording.commands.back().step;
+   result.frames = lastStep + 1 + options.frames;
+   measure(&simulation, result.frames, &result);
+
+   fprintf(stderr, "Replay of %lu steps, %s : %.0f ns/step\n", lastStep + 1, getBroadphaseName(result.broadphase), result.total);
+   return result;
+}
+
+BenchResult runSnapshot(const BenchOptions& options) {
+   BenchResult result = {};
+   SnapshotFile file;
+   if (file.open(options.loadPath)) {
+      result.balls = file.getHeader().ballCount;
+      result.width = file.getHeader().width;
+      result.height = file.getHeader().height;
+   }
+   file.close();
+   result.frames = options.frames;
+   result.threads = options.settings.threads;
+   result.solver = options.settings.solver;
+   result.sleep = options.settings.sleep;
+
+   // An unreadable snapshot leaves the default world empty
+   Simulation simulation(result.width > 0 ? result.width : SCREEN_WIDTH,
+                         result.height > 0 ? result.height : SCREEN_HEIGHT, options.settings);
+   simulation.loadSnapshot(options.loadPath);
+   measure(&simulation, result.frames, &result);
+
+   fprintf(stderr, "%d balls restored, %s : %.0f ns/step\n", result.balls, getBroadphaseName(result.broadphase), result.total);
+   return result;
+}
+
+void measure(Simulation* simulation, int frames, BenchResult* result) {
+   for (int i = 0; i < frames; i++) {
+      Clock::time_point start = Clock::now();
+      simulation->advance();
+      result->total += std::chrono::duration<double>(Clock::now() - start).count();
+
+      const StepTimings& timings = simulation->getTimings();
+      result->phases.commands += timings.commands;
+      result->phases.step += timings.step;
+      result->phases.readBack += timings.readBack;
+      result->phases.publish += timings.publish;
+      for (int j = 0; j < NB_STEP_PHASES; j++)
+         result->phases.phases[j] += timings.phases[j];
+   }
+   result->finalBalls = simulation->getBallCount();
+   result->awakeBalls = simulation->getAwakeCount();
+   result->broadphase = simulation->getBroadphase();
+   result->simd = simulation->usesSimd();
+   result->solver = simulation->getSolverMode();
+   result->substituteStep = simulation->getTimings().substituteStep;
+
+   // Seconds per run to nanoseconds per step
+   double factor = 1e9 / frames;
+   result->total *= factor;
+   result->phases.commands *= factor;
+   result->phases.step *= factor;
+   result->phases.readBack *= factor;
+   result->phases.publish *= factor;
+   for (int j = 0; j < NB_STEP_PHASES; j++)
+      result->phases.phases[j] *= factor;
+}
+
+void printCsv(const std::vector<BenchResult>& results) {
+   printf("balls,final_balls,awake_balls,width,height,frames,threads,solver,simd,sleep,substitute_step,broadphase,ns_per_step,steps_per_s,"
+          "commands_ns,step_ns,readback_ns,publish_ns");
+   for (int j = 0; j < NB_STEP_PHASES; j++)
+      printf(",%s_ns", getStepPhaseName((StepPhase) j));
+   printf("\n");
+   for (unsigned i = 0; i < results.size(); i++) {
+      const BenchResult& r = results[i];
+      printf("%d,%d,%d,%d,%d,%d,%d,%s,%d,%d,%d,%s,%.0f,%.2f,%.0f,%.0f,%.0f,%.0f",
+         r.balls, r.finalBalls, r.awakeBalls, r.width, r.height, r.frames, r.threads, getSolverModeName(r.solver), r.simd, r.sleep,
+         r.substituteStep, getBroadphaseName(r.broadphase),
+         r.total, 1e9 / r.total,
+         r.phases.commands, r.phases.step, r.phases.readBack, r.phases.publish);
+      for (int j = 0; j < NB_STEP_PHASES; j++)
+         printf(",%.0f", r.phases.phases[j]);
+      printf("\n");
+   }
+}
+
+void printJson(const std::vector<BenchResult>& results) {
+   printf("[\n");
+   for (unsigned i = 0; i < results.size(); i++) {
+      const BenchResult& r = results[i];
+      printf("  {\"balls\": %d, \"final_balls\": %d, \"awake_balls\": %d, \"width\": %d, \"height\": %d, \"frames\": %d,\n"
+             "   \"threads\": %d, \"solver\": \"%s\", \"simd\": %s, \"sleep\": %s,\n"
+             "   \"substitute_step\": %s, \"broadphase\": \"%s\", \"ns_per_step\": %.0f, \"steps_per_s\": %.2f,\n"
+             "   \"phases_ns\": {\"commands\": %.0f, \"step\": %.0f, \"readback\": %.0f, \"publish\": %.0f},\n"
+             "   \"step_phases_ns\": {",
+         r.balls, r.finalBalls, r.awakeBalls, r.width, r.height, r.frames, r.threads, getSolverModeName(r.solver),
+         r.simd ? "true" : "false", r.sleep ? "true" : "false",
+         r.substituteStep ? "true" : "false", getBroadphaseName(r.broadphase),
+         r.total, 1e9 / r.total,
+         r.phases.commands, r.phases.step, r.phases.readBack, r.phases.publish);
+      for (int j = 0; j < NB_STEP_PHASES; j++)
+         printf("\"%s\": %.0f%s", getStepPhaseName((StepPhase) j), r.phases.phases[j], j + 1 < NB_STEP_PHASES ? ", " : "");
+      printf("}}%s\n", (i + 1 < results.size()) ? "," : "");
+   }
+   printf("]\n");
 }
@@ -4,19 +4,60 @@
 #include "chipmunk/chipmunk.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <iostream>
 #include <vector>
-#include <sstream>
 #include "SDL2_gfx/SDL2_gfxPrimitives.h"
-#include "Texture.h"
+#include "TextRenderer.h"
 #include "Ball.h"
+#include "Simulation.h"
+#include "BallRenderer.h"
+#include "Camera.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 // Constants ==================================================================
 
 const int SCREEN_WIDTH = 1920;
 const int SCREEN_HEIGHT = 1080;
 
+// Number of frames and of steps the profilers keep
+const unsigned PROFILER_SAMPLES = 240;
+// Frame time at the top of the graph of the profiler, in seconds
+const double PROFILER_GRAPH_MAX = 0.050;
+
+// Number of events kept by the trace, a few minutes of a busy run
+const unsigned TRACE_CAPACITY = 1 << 20;
+
+// Duration of a frame at the target frame rate, the balls are drawn with
+// less detail when frames take longer
+const double FRAME_BUDGET = 1.0 / 60;
+
+// Screen pixels the camera moves by for each press of an arrow key, and
+// zoom factor of each notch of the mouse wheel
+const cpFloat CAMERA_PAN_STEP = 100;
+const cpFloat CAMERA_ZOOM_STEP = 1.25;
+
+// Durations measured for every frame
+enum FrameCounter {
+   FRAME_TOTAL,    // from the start of a frame to the end of its present
+   FRAME_EVENTS,   // event pump and inputs
+   FRAME_RENDER,   // drawing calls
+   FRAME_PRESENT,  // SDL_RenderPresent, which waits for the vertical sync
+   NB_FRAME_COUNTERS
+};
+const std::vector<const char*> FRAME_COUNTER_NAMES = {"frame", "events", "render", "present"};
+
+// Durations measured for every step, after the step phases
+enum StepCounter {
+   STEP_TOTAL = NB_STEP_PHASES,
+   STEP_COMMANDS,
+   STEP_READBACK,
+   STEP_PUBLISH,
+   NB_STEP_COUNTERS
+};
+
 // Functions declarations =====================================================
 
 /**
@@ -39,30 +80,34 @@ bool init(SDL_Window** window, SDL_Renderer** renderer);
 void close(SDL_Window** window, SDL_Renderer** renderer);
 
 /**
- * @brief Calculates the norm of a vector
- * 
- * @param point1 first point of the vector
- * @param point2 second point
- * @return float norm of the vector
+ * @brief Command of <type> at the world point under the mouse
  */
-float calculateNorm(cpVect point1, cpVect point2);
+Command getMouseCommand(CommandType type, const Camera& camera, int count = 0);
 
 /**
- * @brief Adds a ball to the space and adds the ball to the balls list
- * 
- * @param balls_list balls vector
- * @param ball the ball to add
- * @param space existing and initialized cpSpace
+ * @brief Names of the step counters : the phases of the step, then the
+ * durations of StepCounter
  */
-void addBall(std::vector<Ball*>* balls_list, Ball* ball, cpSpace* space);
+std::vector<const char*> getStepCounterNames();
 
 /**
- * @brief Removes every ball from the cpSpace and clears the balls vector
- * 
- * @param space existing cpSpace
- * @param balls balls vector
+ * @brief Fills the step counters with <timings>
+ *
+ * @param values NB_STEP_COUNTERS values
  */
-void clearSpace(cpSpace* space, std::vector<Ball*>* balls);
+void getStepCounters(const StepTimings& timings, double* values);
+
+/**
+ * @brief Draws the graph of the durations of the last frames and steps of
+ * the profilers, and a table of their percentiles under it
+ *
+ * @param substituteStep whether the last step was taken by the stepper
+ * standing in for cpSpaceStep while profiling
+ * @param x left of the overlay
+ * @param y top of the overlay
+ */
+void renderProfiler(SDL_Renderer* renderer, TextRenderer& textRenderer, const Profiler& frames,
+                    const Profiler& steps, bool substituteStep, int x, int y);
 
 // Functions definitions ======================================================
 
@@ -87,7 +132,7 @@ bool init(SDL_Window** window, SDL_Renderer** renderer) {
 
    // Initialization of the texture renderer
    *renderer = SDL_CreateRenderer(*window, -1,
-            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
 
    if(!*renderer) {
       printf("Renderer could not be created. Error : %s\n", SDL_GetError());
@@ -111,10 +156,9 @@ bool init(SDL_Window** window, SDL_Renderer** renderer) {
    return true;
 }
 
-bool loadMedia(SDL_Renderer* renderer, Texture& textTexture) {
-   SDL_Color textColor = {0xFF, 0xFF, 0xFF, 0xFF};
-   if (!textTexture.loadFromRenderedText("MODO Seal3 : Coucou les blablas ^^", textColor, renderer)) {
-      printf("Could not render text texture\n");
+bool loadMedia(SDL_Renderer* renderer, TextRenderer& textRenderer) {
+   if (!textRenderer.load("sources/Minecraft.ttf", 20, renderer)) {
+      printf("Could not load the glyph atlas\n");
       return false;
    }
 
@@ -137,26 +181,92 @@ void close(SDL_Window** window, SDL_Renderer** renderer) {
    SDL_Quit();
 }
 
-float calculateNorm(cpVect point1, cpVect point2) {
-   cpFloat diff_x = pow(point2.x - point1.x, 2);
-   cpFloat diff_y = pow(point2.y - point1.y, 2);
-   cpFloat sum = diff_x + diff_y;
+Command getMouseCommand(CommandType type, const Camera& camera, int count) {
+   int x, y;
+   SDL_GetMouseState(&x, &y);
+   cpVect point = camera.toWorld(cpv(x, y));
+   return {type, (int) floor(point.x), (int) floor(point.y), count};
+}
 
-   return sqrt(sum);
+std::vector<const char*> getStepCounterNames() {
+   std::vector<const char*> names;
+   for (int i = 0; i < NB_STEP_PHASES; i++)
+      names.push_back(getStepPhaseName((StepPhase) i));
+   names.push_back("step");
+   names.push_back("commands");
+   names.push_back("readback");
+   names.push_back("publish");
+   return names;
 }
 
-void addBall(std::vector<Ball*>* balls_list, Ball* ball,cpSpace* space) {
-   ball->createBody(space);
-   balls_list->push_back(ball);
+void getStepCounters(const StepTimings& timings, double* values) {
+   for (int i = 0; i < NB_STEP_PHASES; i++)
+      values[i] = timings.phases[i];
+   values[STEP_TOTAL] = timings.step;
+   values[STEP_COMMANDS] = timings.commands;
+   values[STEP_READBACK] = timings.readBack;
+   values[STEP_PUBLISH] = timings.publish;
 }
 
-void clearSpace(cpSpace* space, std::vector<Ball*>* balls) {
-   for (unsigned i = 0; i < balls->size(); i++) {
-      cpSpaceRemoveShape(space, (*balls)[i]->getShape());
-      cpSpaceRemoveBody(space, (*balls)[i]->getBody());
-      delete (*balls)[i];
+void renderProfiler(SDL_Renderer* renderer, TextRenderer& textRenderer, const Profiler& frames,
+                    const Profiler& steps, bool substituteStep, int x, int y) {
+   const int sampleWidth = 2, graphHeight = 120;
+   const int graphWidth = frames.getCapacity() * sampleWidth;
+
+   // Background, and the durations of a frame at 60 and 30 FPS
+   SDL_Rect background = {x, y, graphWidth, graphHeight};
+   SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xA0);
+   SDL_RenderFillRect(renderer, &background);
+   SDL_SetRenderDrawColor(renderer, 0x60, 0x60, 0x60, 0xFF);
+   for (double limit = 1.0 / 60; limit < PROFILER_GRAPH_MAX; limit *= 2) {
+      int limitY = y + graphHeight - (int) (limit / PROFILER_GRAPH_MAX * graphHeight);
+      SDL_RenderDrawLine(renderer, x, limitY, x + graphWidth, limitY);
+   }
+
+   // Frame times in white, step times in yellow, the latest on the right
+   std::vector<SDL_Point> points;
+   const Profiler* profilers[] = {&frames, &steps};
+   const unsigned counters[] = {FRAME_TOTAL, STEP_TOTAL};
+   const SDL_Color colors[] = {{0xFF, 0xFF, 0xFF, 0xFF}, {0xFF, 0xD0, 0x00, 0xFF}};
+   for (int k = 0; k < 2; k++) {
+      const Profiler& profiler = *profilers[k];
+      points.clear();
+      for (unsigned i = 0; i < profiler.size(); i++) {
+         double value = std::min(profiler.get(i, counters[k]), PROFILER_GRAPH_MAX);
+         int pointX = x + graphWidth - (profiler.size() - i) * sampleWidth;
+         points.push_back({pointX, y + graphHeight - (int) (value / PROFILER_GRAPH_MAX * graphHeight)});
+      }
+      SDL_SetRenderDrawColor(renderer, colors[k].r, colors[k].g, colors[k].b, colors[k].a);
+      if (points.size() > 1)
+         SDL_RenderDrawLines(renderer, points.data(), points.size());
+   }
+
+   // Percentiles of every counter, in milliseconds
+   char text[64];
+   const int columns[] = {0, 150, 240, 330};
+   int lineY = y + graphHeight + 10;
+   const char* headers[] = {"ms", "p50", "p95", "p99"};
+   for (int c = 0; c < 4; c++)
+      textRenderer.render(renderer, headers[c], x + columns[c], lineY, {0xA0, 0xA0, 0xA0, 0xFF});
+   for (int k = 0; k < 2; k++) {
+      const Profiler& profiler = *profilers[k];
+      for (unsigned counter = 0; counter < profiler.getCounterCount(); counter++) {
+         lineY += textRenderer.getLineHeight();
+         textRenderer.render(renderer, profiler.getName(counter), x, lineY, colors[k]);
+         const double percentiles[] = {50, 95, 99};
+         for (int c = 0; c < 3; c++) {
+            snprintf(text, sizeof(text), "%.2f", profiler.getPercentile(counter, percentiles[c]) * 1000);
+            textRenderer.render(renderer, text, x + columns[c + 1], lineY, colors[k]);
+         }
+      }
+   }
+
+   // cpSpaceStep can not be timed, the steps are then taken by another stepper
+   if (substituteStep) {
+      lineY += textRenderer.getLineHeight();
+      textRenderer.render(renderer, "Step phases timed on a 1 thread islands step standing in for cpSpaceStep",
+                          x, lineY, {0xA0, 0xA0, 0xA0, 0xFF});
    }
-   balls->clear();
 }
 
 int main(int argc, char const *argv[])  
@@ -168,67 +278,92 @@ int main(int argc, char const *argv[])
    bool quit = false;
 
    // SDL_Font related stuff
-   Texture textTexture;
-   textTexture.setPosition(50, 50);
+   TextRenderer textRenderer;
+   char hudText[256];
+
+   // Command line. The phases of the steps are timed while the profiler is
+   // shown, or all along with --profile on.
+   SimulationSettings settings;
+   const char* recordPath = NULL;
+   const char* replayPath = NULL;
+   const char* tracePath = NULL;
+   int worldWidth = SCREEN_WIDTH, worldHeight = SCREEN_HEIGHT;
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+         recordPath = argv[++i];
+      else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+         replayPath = argv[++i];
+      else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+         tracePath = argv[++i];
+      else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+         worldWidth = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+         worldHeight = atoi(argv[++i]);
+      else if (!parseSimulationOption(argc, argv, &i, &settings)) {
+         printf("Usage: %s [--record FILE | --replay FILE] [--trace FILE] [--width W --height H] %s\n",
+                argv[0], SIMULATION_USAGE);
+         return 1;
+      }
+   }
+   if (tracePath) {
+      startTracing(TRACE_CAPACITY);
+      setTraceThreadName("render");
+   }
+
+   // A replay runs the world of the recording, and ignores the inputs
+   Recording replay;
+   bool replaying = replayPath != NULL;
+   if (replaying) {
+      if (!loadRecording(replayPath, &replay))
+         return 1;
+      settings.seed = replay.seed;
+      settings.spawn = replay.spawn;
+      worldWidth = replay.width;
+      worldHeight = replay.height;
+   }
 
    // Initialization of SDL
    if (!init(&window, &renderer))
       quit = true;
    
-   if (!textTexture.initFont("sources/Minecraft.ttf"))
-      return false;
-
    // Initialization of the text
-   if (!loadMedia(renderer, textTexture))
+   if (!loadMedia(renderer, textRenderer))
       quit = true;
 
-   // Chipmunk stuff
-   cpVect gravity = cpv(0, 1000);
-
-   // Creation of the new space
-   cpSpace* space = cpSpaceNew();
-   cpSpaceSetGravity(space, gravity);
-   
-   // Creation of the walls
-   const int NB_WALLS = 4;
-
-   Segment floor = {{0, SCREEN_HEIGHT-10}, {SCREEN_WIDTH, SCREEN_HEIGHT-10}};
-   Segment roof = {{0, 10}, {SCREEN_WIDTH, 10}};
-   Segment leftWall = { { 10, 0 },{ 10, SCREEN_HEIGHT } };
-   Segment rightWall = { { SCREEN_WIDTH-10, 0 },{ SCREEN_WIDTH-10, SCREEN_HEIGHT } };
-
-   cpShape* ground[4] = {cpSegmentShapeNew(cpSpaceGetStaticBody(space), floor.a, floor.b, 0), 
-                         cpSegmentShapeNew(cpSpaceGetStaticBody(space), roof.a, roof.b, 0), 
-                         cpSegmentShapeNew(cpSpaceGetStaticBody(space), leftWall.a, leftWall.b, 0), 
-                         cpSegmentShapeNew(cpSpaceGetStaticBody(space), rightWall.a, rightWall.b, 0) };
-                         
-   for(int i = 0; i < NB_WALLS; i++) {
-      cpShapeSetFriction(ground[i], 0.5);
-      cpShapeSetElasticity(ground[i], 0);
-      cpSpaceAddShape(space, ground[i]);
-   }
-
-   // Balls
-   std::vector<Ball*> balls;
-
-   // Constraint management
+   // Chipmunk stuff, stepped on its own thread
+   Simulation simulation(worldWidth, worldHeight, settings);
+   const Segment* walls = simulation.getWalls();
+   if (replaying)
+      simulation.replay(replay);
+   if (recordPath)
+      simulation.startRecording();
+   simulation.start();
+
+   BallRenderer ballRenderer;
+   ballRenderer.setSimd(settings.simd);
+
+   // The whole world is in view at first, it is the screen by default
+   const cpBB worldBounds = cpBBNew(0, 0, worldWidth, worldHeight);
+   Camera camera(SCREEN_WIDTH, SCREEN_HEIGHT);
+   camera.fit(worldBounds);
+
+   // Constraint management, the mouse end of the link is moved whenever the
+   // world point under the mouse changes
    int NB_BALLS_TO_ADD = 1;
-   cpConstraint* mouseConstraint = NULL;
-   int linkedBallId = -1;
-
-   unsigned NB_BALLS = 0;
+   bool dragging = false;
+   Command lastDrag = {COMMAND_DRAG, 0, 0, 0};
 
-   // FPS management
-   const float SCREEN_FPS = 60.0;
-   const float SCREEN_TICKS_PER_FRAME = 1000.0 / SCREEN_FPS;
-   cpFloat timeStep = 1.0/SCREEN_FPS;
-   Uint32 startTicks, ticksDifference;
-   std::stringstream fpsText;
-   int countedFrames = 0;
+   // Profilers of the frames and of the steps, the FPS are taken from the
+   // durations of the last frames
+   Profiler frameProfiler(FRAME_COUNTER_NAMES, PROFILER_SAMPLES);
+   Profiler stepProfiler(getStepCounterNames(), PROFILER_SAMPLES);
+   double frameCounters[NB_FRAME_COUNTERS], stepCounters[NB_STEP_COUNTERS];
+   unsigned long profiledStep = 0;
+   bool showProfiler = false;
 
    // Main loop
    while (!quit) {
-      startTicks = SDL_GetTicks();
+      Clock::time_point frameStart = Clock::now();
       // Events manager
       while (SDL_PollEvent(&e) != 0) {
          if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE))
@@ -236,14 +371,9 @@ int main(int argc, char const *argv[])
          else if (e.type == SDL_KEYDOWN) {
             switch(e.key.keysym.sym) {
                case SDLK_r:
-                  if (mouseConstraint) {
-                     cpSpaceRemoveConstraint(space, mouseConstraint);
-                     cpConstraintFree(mouseConstraint);
-                     mouseConstraint = NULL;
-                     linkedBallId = -1;
-                  }
-                  NB_BALLS = 0;
-                  clearSpace(space, &balls);
+                  dragging = false;
+                  if (!replaying)
+                     simulation.pushCommand({COMMAND_RESET, 0, 0, 0});
                   break;
                case SDLK_p:
                   NB_BALLS_TO_ADD += 10;
@@ -255,52 +385,101 @@ int main(int argc, char const *argv[])
                      NB_BALLS_TO_ADD = 1;
                   printf("Nb balls to add set to %d\n", NB_BALLS_TO_ADD);
                   break;
+               case SDLK_F5:
+                  simulation.pushCommand({COMMAND_SAVE, 0, 0, 0});
+                  break;
+               case SDLK_F9:
+                  dragging = false;
+                  if (!replaying)
+                     simulation.pushCommand({COMMAND_LOAD, 0, 0, 0});
+                  break;
+               case SDLK_F3:
+                  showProfiler = !showProfiler;
+                  simulation.setProfiling(showProfiler || settings.profile);
+                  break;
+               case SDLK_F4:
+                  if (frameProfiler.save("profile-frames.csv", 1000) && stepProfiler.save("profile-steps.csv", 1000))
+                     printf("Profiler counters written into profile-frames.csv and profile-steps.csv\n");
+                  break;
+               case SDLK_F8:
+                  if (tracePath)
+                     saveTrace(tracePath);
+                  break;
+               case SDLK_f:
+                  simulation.pushCommand(getMouseCommand(COMMAND_FOLLOW, camera));
+                  break;
+               case SDLK_c:
+                  camera.fit(worldBounds);
+                  break;
+               case SDLK_LEFT:
+                  camera.pan(cpv(CAMERA_PAN_STEP, 0));
+                  break;
+               case SDLK_RIGHT:
+                  camera.pan(cpv(-CAMERA_PAN_STEP, 0));
+                  break;
+               case SDLK_UP:
+                  camera.pan(cpv(0, CAMERA_PAN_STEP));
+                  break;
+               case SDLK_DOWN:
+                  camera.pan(cpv(0, -CAMERA_PAN_STEP));
+                  break;
+               case SDLK_b:
+                  ballRenderer.setMode((RenderMode) ((ballRenderer.getMode() + 1) % NB_RENDER_MODES));
+                  printf("Render mode set to %s\n", BallRenderer::getModeName(ballRenderer.getMode()));
+                  break;
             }
          } 
-         else if (e.type == SDL_MOUSEBUTTONDOWN && !mouseConstraint) {
-            int x, y;
-            Uint32 button = SDL_GetMouseState(&x, &y);
-            if (button == 1) {
-               for (int i = 0; i < NB_BALLS_TO_ADD; i++) {
-                  int radius = 30, mass = 5;
-                  SDL_Color color;
-                  color.r = (Uint32) (rand() % 0xFF);
-                  color.g = (Uint32) (rand() % 0xFF);
-                  color.b = (Uint32) (rand() % 0xFF);
-                  color.a = 0xFF;
-                  Ball* b = new Ball({rand() % SCREEN_WIDTH, rand() % SCREEN_HEIGHT}, mass, radius, color);
-                  if (NB_BALLS_TO_ADD == 1)
-                     b->setPosition(x, y);
-                        
-                  addBall(&balls, b, space);
-               }
-               NB_BALLS += NB_BALLS_TO_ADD;
-               printf("%d %s added at (%d, %d)\n", NB_BALLS_TO_ADD,
-                      (NB_BALLS_TO_ADD==1)?"ball":"balls", x, y);
-            }
+         else if (e.type == SDL_MOUSEBUTTONDOWN && !dragging && !replaying) {
+            Uint32 button = SDL_GetMouseState(NULL, NULL);
+            if (button == 1)
+               simulation.pushCommand(getMouseCommand(COMMAND_SPAWN, camera, NB_BALLS_TO_ADD));
             else if (button == 4) {
-               for (Uint32 i = 0; i < balls.size(); i++) {
-                  if (calculateNorm(cpv(x, y), cpv(balls[i]->getPosition().x, balls[i]->getPosition().y)) <= balls[i]->getRadius()) {
-                     linkedBallId = i;
-                     mouseConstraint = cpPivotJointNew(balls[i]->getBody(), cpSpaceGetStaticBody(space), cpv(x, y));
-                     cpSpaceAddConstraint(space, mouseConstraint);
-                     break;
-                  }
-               }
+               dragging = true;
+               lastDrag = getMouseCommand(COMMAND_DRAG, camera);
+               simulation.pushCommand(getMouseCommand(COMMAND_GRAB, camera));
             }
          }
-         else if (e.type == SDL_MOUSEBUTTONUP && mouseConstraint) {
-            cpSpaceRemoveConstraint(space, mouseConstraint);
-            cpConstraintFree(mouseConstraint);
-            mouseConstraint = NULL;
-            linkedBallId = -1;
+         else if (e.type == SDL_MOUSEBUTTONUP && dragging) {
+            dragging = false;
+            simulation.pushCommand({COMMAND_RELEASE, 0, 0, 0});
          }
          else if (e.type == SDL_MOUSEMOTION) {
-            if (mouseConstraint) {
-               int x, y;
-               SDL_GetMouseState(&x, &y);
-               cpPivotJointSetAnchorB(mouseConstraint, cpv(x, y));
-            }
+            // The middle button drags the view
+            if (e.motion.state & SDL_BUTTON_MMASK)
+               camera.pan(cpv(e.motion.xrel, e.motion.yrel));
+         }
+         else if (e.type == SDL_MOUSEWHEEL) {
+            int x, y;
+            SDL_GetMouseState(&x, &y);
+            camera.zoomAt(cpv(x, y), pow(CAMERA_ZOOM_STEP, e.wheel.y));
+         }
+      }
+
+      Clock::time_point renderStart = Clock::now();
+      frameCounters[FRAME_EVENTS] = std::chrono::duration<double>(renderStart - frameStart).count();
+
+      // Latest world published by the physics thread, the timings of its
+      // step are profiled once
+      const WorldState& state = simulation.getState();
+      cpFloat alpha = simulation.getAlpha(state);
+      if (state.stepCount != profiledStep) {
+         profiledStep = state.stepCount;
+         getStepCounters(state.timings, stepCounters);
+         stepProfiler.add(stepCounters);
+      }
+
+      // The camera is placed for this frame, the balls in its view are
+      // gathered for the next states
+      if (state.followedBallId >= 0)
+         camera.setCenter(cpvlerp(state.balls.previousPositions[state.followedBallId],
+                                  state.balls.positions[state.followedBallId], alpha));
+      simulation.setViewport(camera.getViewport());
+      cpTransform view = camera.getTransform();
+      if (dragging) {
+         Command drag = getMouseCommand(COMMAND_DRAG, camera);
+         if (drag.x != lastDrag.x || drag.y != lastDrag.y) {
+            simulation.pushCommand(drag);
+            lastDrag = drag;
          }
       }
 
@@ -310,79 +489,72 @@ int main(int argc, char const *argv[])
 
       // Render walls
       SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0xFF, 0xFF );  
-      SDL_RenderDrawLine(renderer, floor.a.x, floor.a.y, floor.b.x, floor.b.y);
-      SDL_RenderDrawLine(renderer, roof.a.x, roof.a.y, roof.b.x, roof.b.y);
-      SDL_RenderDrawLine(renderer, leftWall.a.x, leftWall.a.y, leftWall.b.x, leftWall.b.y);
-      SDL_RenderDrawLine(renderer, rightWall.a.x, rightWall.a.y, rightWall.b.x, rightWall.b.y);
+      for (int i = 0; i < Simulation::NB_WALLS; i++) {
+         cpVect a = cpTransformPoint(view, walls[i].a), b = cpTransformPoint(view, walls[i].b);
+         SDL_RenderDrawLine(renderer, a.x, a.y, b.x, b.y);
+      }
       
       // Render balls
-      for(unsigned i = 0; i < balls.size(); i++) {
-         if (balls[i]->getPosition().x > SCREEN_WIDTH || balls[i]->getPosition().x < 0
-             || balls[i]->getPosition().y > SCREEN_HEIGHT || balls[i]->getPosition().y < 0){
-               cpSpaceRemoveShape(space, balls[i]->getShape());
-               cpSpaceRemoveBody(space, balls[i]->getBody());
-               delete balls[i];
-               balls.erase(balls.begin() + i);
-            }
-         else
-            balls[i]->render(renderer);
-      }
+      ballRenderer.render(renderer, state.balls, state.visible, state.viewport, view, alpha);
 
       // Render constraints
-      if (mouseConstraint) {
+      if (state.linkedBallId >= 0) {
          int x, y;
          SDL_GetMouseState(&x, &y);
+         cpVect linkedPosition = cpTransformPoint(view, cpvlerp(state.balls.previousPositions[state.linkedBallId],
+                                                                state.balls.positions[state.linkedBallId], alpha));
 
-         SDL_RenderDrawLine(renderer, x, y, balls[linkedBallId]->getPosition().x, balls[linkedBallId]->getPosition().y);
+         SDL_RenderDrawLine(renderer, x, y, linkedPosition.x, linkedPosition.y);
 
 
-         aalineRGBA(renderer, x, y, balls[linkedBallId]->getPosition().x, balls[linkedBallId]->getPosition().y, 0x00, 0xFF, 0x00, 0xFF * 0.5);
+         aalineRGBA(renderer, x, y, linkedPosition.x, linkedPosition.y, 0x00, 0xFF, 0x00, 0xFF * 0.5);
 
 
-         filledCircleRGBA(renderer, balls[linkedBallId]->getPosition().x, balls[linkedBallId]->getPosition().y, 2, 0x00,
+         filledCircleRGBA(renderer, linkedPosition.x, linkedPosition.y, 2, 0x00,
                           0xFF, 0x00, 255);
          filledCircleRGBA(renderer, x, y, 2, 0x00, 0xFF, 0x00, 255);
       }
 
       // Render text
-      // TODO: make a not shity FPS counter
-      float avgFPS = countedFrames / (startTicks / 1000.0);
-      if (avgFPS > 2000000)
-         avgFPS = 0;
-      
-      fpsText.str("");
-      fpsText << "Balls count : " << balls.size() << " - FPS : " << round(avgFPS);
-      if (!textTexture.loadFromRenderedText(fpsText.str().c_str(), {0xFF, 0xFF, 0xFF, 0xFF}, renderer))
-         printf("Could not render text\n");
-      textTexture.render(renderer);
-      
+      double meanFrame = frameProfiler.getMean(FRAME_TOTAL);
+      int fps = meanFrame > 0 ? (int) round(1 / meanFrame) : 0;
+      unsigned ballCount = state.balls.size();
+      snprintf(hudText, sizeof(hudText), "Balls count : %u (awake : %u, asleep : %u, visible : %u) - FPS : %d - Broadphase : %s - Zoom : %.2f - Detail : %s",
+               ballCount, state.awakeBalls, ballCount - state.awakeBalls, (unsigned) state.visible.size(), fps,
+               getBroadphaseName(state.broadphase), camera.getZoom(),
+               BallRenderer::getDetailLevelName(ballRenderer.getDetailLevel()));
+      textRenderer.render(renderer, hudText, 50, 50, {0xFF, 0xFF, 0xFF, 0xFF});
+      if (showProfiler)
+         renderProfiler(renderer, textRenderer, frameProfiler, stepProfiler, state.timings.substituteStep, 50, 100);
+
+      Clock::time_point presentStart = Clock::now();
+      frameCounters[FRAME_RENDER] = std::chrono::duration<double>(presentStart - renderStart).count();
+
       // Update screen
       SDL_RenderPresent(renderer);
 
-      // Step
-      cpSpaceStep(space, timeStep);
-
-      // Keeping <SCREEN_FPS> FPS
-      ++ countedFrames;
-      ticksDifference = SDL_GetTicks() - startTicks;
-      if (ticksDifference < SCREEN_TICKS_PER_FRAME)
-         SDL_Delay(SCREEN_TICKS_PER_FRAME - ticksDifference);
+      Clock::time_point frameEnd = Clock::now();
+      frameCounters[FRAME_PRESENT] = std::chrono::duration<double>(frameEnd - presentStart).count();
+      frameCounters[FRAME_TOTAL] = std::chrono::duration<double>(frameEnd - frameStart).count();
+      frameProfiler.add(frameCounters);
+      // The present waits for the vertical sync, only the work of the frame
+      // tells how close it is to the budget
+      ballRenderer.adaptDetail(frameCounters[FRAME_EVENTS] + frameCounters[FRAME_RENDER], FRAME_BUDGET);
+
+      traceEvent("frame", frameStart, frameEnd);
+      traceEvent("events", frameStart, renderStart);
+      traceEvent("render", renderStart, presentStart);
+      traceEvent("present", presentStart, frameEnd);
    }
 
-   clearSpace(space, &balls);
-   
-   for(unsigned i = 0; i < NB_WALLS; i++)
-      cpShapeFree(ground[i]);
-
-   if (mouseConstraint) {
-      cpSpaceRemoveConstraint(space, mouseConstraint);
-      cpConstraintFree(mouseConstraint);
-      mouseConstraint = NULL;
-      linkedBallId = -1;
-   }
-   cpSpaceFree(space);
-   space = NULL;
+   simulation.stop();
+   if (tracePath)
+      saveTrace(tracePath);
+   if (recordPath && saveRecording(recordPath, simulation.getRecording()))
+      printf("%u commands recorded into %s\n", (unsigned) simulation.getRecording().commands.size(), recordPath);
 
+   ballRenderer.free();
+   textRenderer.free();
    close(&window, &renderer);
    return 0;
-}
+}
\ No newline at end of file